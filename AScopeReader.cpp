@@ -23,10 +23,15 @@
 // *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* 
 #include "AScopeReader.h"
 #include <cerrno>
+#include <algorithm>
+#include <QDateTime>
 #include <radar/iwrf_functions.hh>
 #include <toolsa/uusleep.h>
 using namespace std;
 
+const double AScopeReader::INGEST_LAG_SECS = 0.5;
+const double AScopeReader::NETWORK_STALL_SECS = 0.25;
+
 // Note that the timer interval for QtTSReader is 0
 
 AScopeReader::AScopeReader(const string &host,
@@ -36,7 +41,8 @@ AScopeReader::AScopeReader(const string &host,
                            AScope &scope,
                            int radarId,
                            int burstChan,
-                           int debugLevel):
+                           int debugLevel,
+                           IwrfTsReader *pulseReader):
         _radarId(radarId),
         _burstChan(burstChan),
         _debugLevel(debugLevel),
@@ -45,16 +51,50 @@ AScopeReader::AScopeReader(const string &host,
         _serverFmq(fmqPath),
         _simulMode(simulMode),
         _scope(scope),
+        _pulseReader(pulseReader),
+        _streamReader(dynamic_cast<StreamTsReader *>(pulseReader)),
+        _externalReader(pulseReader != NULL),
+        _compressed(false),
+        _lockBuffers(false),
+        _hugePages(false),
+        _stallSecs(0.0),
+        _backoffMsecs(0),
+        _nReconnects(0),
+        _nReadErrors(0),
+        _nBytesSkippedPrev(0),
+        _jitterReportSecs(0.0),
+        _haveTick(false),
+        _tickDeadlineMsecs(0.0),
+        _tickEndMsecs(0.0),
+        _jitterIndex(0),
+        _blockSize(scope.getBlockSize()),
         _pulseCount(0),
+        _minLatency(0.0),
+        _gapAction(GAP_ACTION_NONE),
+        _pendingPulse(NULL),
+        _nSeqGaps(0),
+        _nPulsesMissed(0),
+        _nDuplicates(0),
+        _nReorders(0),
+        _nSeqResets(0),
+        _nIngestGaps(0),
+        _nUpstreamGaps(0),
+        _nNetworkStalls(0),
+        _decimateWidth(0),
+        _history(NULL),
         _tsSeqNum(0)
 {
   
   // this are required in order to send structured data types
   // via a qt signal
   qRegisterMetaType<AScope::TimeSeries>();
+  qRegisterMetaType<RangeTimeHistory::row_t>();
   
   // start timer for checking socket every 50 msecs
-  _dataTimerId = startTimer(50);
+  // precise, so that jitter reports reflect scheduling
+  _dataTimerId = startTimer(DATA_TIMER_MSECS, Qt::PreciseTimer);
+  _jitterClock.start();
+  _sinceJitterReport.start();
 
   // pulse mode
 
@@ -62,27 +102,200 @@ AScopeReader::AScopeReader(const string &host,
 
   // pulse reader
 
+  if (!_externalReader) {
+    _createPulseReader();
+  }
+  _haveChan1 = false;
+  _sinceLastPulse.start();
+  _sinceLastFailure.start();
+
+}
+
+AScopeReader::~AScopeReader()
+
+{
+
+  _freePulses();
+  if (_pendingPulse) {
+    delete _pendingPulse;
+  }
+  if (_pulseReader) {
+    delete _pulseReader;
+  }
+  if (_history) {
+    delete _history;
+  }
+
+}
+
+//////////////////////////////////////////////////////////////
+// set up the range-time history
+
+void AScopeReader::setHistory(int maxRows, int maxGates, double maxAgeSecs)
+{
+
+  if (_history) {
+    delete _history;
+    _history = NULL;
+  }
+  if (maxRows > 0) {
+    _history = new RangeTimeHistory(maxRows, maxGates, maxAgeSecs,
+                                    _hugePages);
+    string errStr;
+    if (_lockBuffers && _history->lockMemory(errStr)) {
+      cerr << "WARNING - AScopeReader: " << errStr << endl;
+    }
+  }
+
+}
+
+//////////////////////////////////////////////////////////////
+// lock the history and stream buffers in memory
+
+int AScopeReader::lockBuffers(string &errStr)
+{
+
+  _lockBuffers = true;
+  int iret = 0;
+  if (_history && _history->lockMemory(errStr)) {
+    iret = -1;
+  }
+  if (_lockReaderBuffers(errStr)) {
+    iret = -1;
+  }
+  return iret;
+
+}
+
+int AScopeReader::_lockReaderBuffers(string &errStr)
+{
+
+  if (_streamReader == NULL) {
+    return 0;
+  }
+  return _streamReader->lockBuffers(errStr);
+
+}
+
+//////////////////////////////////////////////////////////////
+// switch between raw and compressed streams
+
+void AScopeReader::setCompressed(bool compressed)
+{
+
+  if (compressed == _compressed || _externalReader) {
+    return;
+  }
+  _compressed = compressed;
+  _freePulses();
+  delete _pulseReader;
+  _createPulseReader();
+
+}
+
+//////////////////////////////////////////////////////////////
+// bytes skipped resynchronising, over all readers
+
+si64 AScopeReader::getNBytesSkipped() const
+{
+
+  si64 nSkipped = _nBytesSkippedPrev;
+  if (_streamReader != NULL) {
+    nSkipped += _streamReader->getNBytesSkipped();
+  }
+  return nSkipped;
+
+}
+
+//////////////////////////////////////////////////////////////
+// create the pulse reader, for FMQ, TCP or compressed TCP
+
+void AScopeReader::_createPulseReader()
+{
+
+  _streamReader = NULL;
   if (_serverFmq.size() > 0) {
     _pulseReader = new IwrfTsReaderFmq(_serverFmq.c_str());
+    if (_radarId != 0) {
+      _pulseReader->setRadarId(_radarId);
+    }
+    _pulseReader->setNonBlocking(50);
+  } else if (_compressed) {
+    // the stream readers filter on radar id themselves, and
+    // never block
+    _streamReader = new CompressedTsReader(_serverHost, _serverPort,
+                                           _radarId, _debugLevel);
+    _pulseReader = _streamReader;
   } else {
-    _pulseReader = new IwrfTsReaderTcp(_serverHost.c_str(), _serverPort);
+    _streamReader = new IwrfStreamReader(_serverHost, _serverPort,
+                                         _radarId, _debugLevel);
+    _pulseReader = _streamReader;
   }
-  if (_radarId != 0) {
-    _pulseReader->setRadarId(_radarId);
+
+  string errStr;
+  if (_lockBuffers && _lockReaderBuffers(errStr)) {
+    cerr << "WARNING - AScopeReader: " << errStr << endl;
   }
-  _haveChan1 = false;
-  _pulseReader->setNonBlocking(50);
 
 }
 
-AScopeReader::~AScopeReader()
+//////////////////////////////////////////////////////////////
+// discard the reader and any partial block, and start again
+// with a fresh reader.
+//
+// The new reader opens its connection on the next read. Reads
+// are held off for the backoff period, which doubles on each
+// consecutive failure and is cleared by the first good pulse.
 
+void AScopeReader::_reconnect(const string &reason)
 {
 
-  if (_pulseReader) {
+  if (_backoffMsecs == 0) {
+    _backoffMsecs = MIN_BACKOFF_MSECS;
+  } else {
+    _backoffMsecs *= 2;
+    if (_backoffMsecs > MAX_BACKOFF_MSECS) {
+      _backoffMsecs = MAX_BACKOFF_MSECS;
+    }
+  }
+
+  _nReconnects++;
+  cerr << "WARNING - AScopeReader: " << reason
+       << ", reconnecting in " << _backoffMsecs << " msecs" << endl;
+  if (_debugLevel > 0) {
+    printStats(cerr);
+  }
+
+  // pulses from the old connection may not join up with
+  // those from the new one, so drop the partial block
+
+  _freePulses();
+  if (_pendingPulse) {
+    delete _pendingPulse;
+    _pendingPulse = NULL;
+  }
+  _resetSequence();
+
+  if (!_externalReader) {
+    _nBytesSkippedPrev = getNBytesSkipped();
     delete _pulseReader;
+    _createPulseReader();
   }
 
+  _sinceLastFailure.restart();
+  _sinceLastPulse.restart();
+
+}
+
+//////////////////////////////////////////////////////////////
+// stop the data timer
+
+void AScopeReader::stop()
+{
+  if (_dataTimerId != 0) {
+    killTimer(_dataTimerId);
+    _dataTimerId = 0;
+  }
 }
 
 //////////////////////////////////////////////////////////////
@@ -97,16 +310,109 @@ void AScopeReader::timerEvent(QTimerEvent *event)
       cerr << "Servicing socket timer event" << endl;
     }
 
-    // read data from server, until enough data is gathered
+    if (_jitterReportSecs > 0) {
+      _updateJitter();
+    }
+
+    pollData();
 
-    if (_readData() == 0) {
-      _sendDataToAScope();
+    if (_jitterReportSecs > 0) {
+      _tickEndMsecs = _jitterClock.nsecsElapsed() / 1.0e6;
     }
 
   } // if (event->timerId() == _dataTimerId)
     
 }
 
+//////////////////////////////////////////////////////////////
+// read data from server, until enough data is gathered
+
+void AScopeReader::pollData()
+{
+
+  if (_readData() == 0) {
+    _sendDataToAScope();
+  }
+
+}
+
+//////////////////////////////////////////////////////////////
+// record the lateness of this timer tick, and report
+// percentiles when the interval is up
+
+void AScopeReader::_updateJitter()
+{
+
+  double nowMsecs = _jitterClock.nsecsElapsed() / 1.0e6;
+
+  // the first tick only sets the next deadline - the time before
+  // it includes startup
+
+  if (!_haveTick) {
+    _tickDeadlineMsecs = nowMsecs + DATA_TIMER_MSECS;
+    _haveTick = true;
+    return;
+  }
+
+  // a precise timer does not fire early - if it has, our deadline
+  // was set late, from a late first tick
+
+  if (nowMsecs < _tickDeadlineMsecs) {
+    _tickDeadlineMsecs = nowMsecs;
+  }
+
+  // late from when the tick could have run - the deadline, or the
+  // end of the previous tick if that ran past it. The time spent
+  // in our handler, e.g. waiting for data, is not latency.
+
+  double readyMsecs = max(_tickDeadlineMsecs, _tickEndMsecs);
+  double lateMsecs = nowMsecs - readyMsecs;
+  if (lateMsecs < 0) {
+    lateMsecs = 0;
+  }
+
+  // next deadline, as the precise timer sets it - one period on,
+  // or one period from now if that has already gone
+
+  _tickDeadlineMsecs += DATA_TIMER_MSECS;
+  if (_tickDeadlineMsecs < nowMsecs) {
+    _tickDeadlineMsecs = nowMsecs + DATA_TIMER_MSECS;
+  }
+
+  if ((int) _jitterMsecs.size() < MAX_JITTER_SAMPLES) {
+    _jitterMsecs.push_back(lateMsecs);
+  } else {
+    _jitterMsecs[_jitterIndex] = lateMsecs;
+  }
+  _jitterIndex = (_jitterIndex + 1) % MAX_JITTER_SAMPLES;
+
+  if (_sinceJitterReport.elapsed() > _jitterReportSecs * 1000.0) {
+    _reportJitter();
+    _sinceJitterReport.restart();
+  }
+
+}
+
+void AScopeReader::_reportJitter()
+{
+
+  if (_jitterMsecs.empty()) {
+    return;
+  }
+
+  vector<double> sorted(_jitterMsecs);
+  sort(sorted.begin(), sorted.end());
+  size_t nn = sorted.size();
+
+  cerr << "AScopeReader ingest timer lateness (msecs), nSamples "
+       << nn << ":"
+       << " p50 " << sorted[nn / 2]
+       << " p90 " << sorted[(nn * 90) / 100]
+       << " p99 " << sorted[(nn * 99) / 100]
+       << " max " << sorted[nn - 1] << endl;
+
+}
+
 /////////////////////////////
 // read data from the server
 // returns 0 on succes, -1 on failure (not enough data)
@@ -117,22 +423,73 @@ int AScopeReader::_readData()
 
   // read data until nSamples pulses have been gathered
   
-  _nSamples = _scope.getBlockSize();
+  _nSamples = _blockSize.loadAcquire();
   
   MemBuf buf;
   while (true) {
     
-    // read in a pulse
+    // read in a pulse, starting with any held over from a split
     
-    IwrfTsPulse *pulse = _getNextPulse();
+    IwrfTsPulse *pulse = _pendingPulse;
+    _pendingPulse = NULL;
+
     if (pulse == NULL) {
-      // No data yet; return to event loop
-      return -1;
-    }
-    _pulseCount++;
-    if (pulse->getIq0() == NULL) {
-      cerr << "WARNING - pulse has NULL data" << endl;
-      continue;
+
+      pulse = _getNextPulse();
+      if (pulse == NULL) {
+        // No data yet; return to event loop
+        return -1;
+      }
+      _pulseCount++;
+
+      // check the pulse sequence - before the data check, so that
+      // a pulse without data is not later counted as lost, and a
+      // gap it carries still breaks the block
+
+      seqStatus_t seqStatus = _checkSequence(pulse);
+      if (seqStatus == SEQ_DUPLICATE) {
+        delete pulse;
+        continue;
+      }
+      if (seqStatus == SEQ_REORDER && _gapAction != GAP_ACTION_NONE) {
+        // too late for its place in the block - drop it, and
+        // keep the block, which is still in order
+        delete pulse;
+        continue;
+      }
+      bool nullData = (pulse->getIq0() == NULL);
+      if (nullData) {
+        cerr << "WARNING - pulse has NULL data" << endl;
+      }
+
+      if ((seqStatus == SEQ_GAP || seqStatus == SEQ_RESET) &&
+          _gapAction != GAP_ACTION_NONE) {
+        if (_gapAction == GAP_ACTION_SPLIT &&
+            (_pulses.size() >= 2 || _pulsesV.size() >= 2)) {
+          // send what we have, start the next block with this pulse
+          if (nullData) {
+            delete pulse;
+          } else {
+            _pendingPulse = pulse;
+          }
+          if (_pulsesV.size() == 0) {
+            _channelMode = CHANNEL_MODE_HV_SIM;
+          } else if (_pulses.size() == 0) {
+            _channelMode = CHANNEL_MODE_V_ONLY;
+          } else {
+            _channelMode = CHANNEL_MODE_ALTERNATING;
+          }
+          return 0;
+        }
+        // drop the pulses before the break
+        _freePulses();
+      }
+
+      if (nullData) {
+        delete pulse;
+        continue;
+      }
+
     }
 
     if (pulse->getIq1() == NULL) {
@@ -193,6 +550,154 @@ int AScopeReader::_readData()
 
 }
 
+///////////////////////////////////////////////////////
+// check the pulse sequence number against the previous
+// pulse from the same radar, and update the loss counters
+
+AScopeReader::seqStatus_t
+  AScopeReader::_checkSequence(const IwrfTsPulse *pulse)
+
+{
+
+  int radarId = pulse->getHdr().packet.radar_id;
+  si64 seqNum = pulse->get_pulse_seq_num();
+  double pulseTime = pulse->getFTime();
+  double now = QDateTime::currentMSecsSinceEpoch() / 1000.0;
+
+  // latency relative to the lowest seen, so that clock offset
+  // between us and the server cancels out
+
+  double latency = now - pulseTime;
+  if (_seqStates.empty() || latency < _minLatency) {
+    _minLatency = latency;
+  }
+  double lag = latency - _minLatency;
+
+  map<int, seqState_t>::iterator it = _seqStates.find(radarId);
+  if (it == _seqStates.end()) {
+    seqState_t state;
+    state.seqNum = seqNum;
+    state.pulseTime = pulseTime;
+    state.arrivalTime = now;
+    _seqStates[radarId] = state;
+    return SEQ_OK;
+  }
+  seqState_t &state = it->second;
+
+  si64 delta = seqNum - state.seqNum;
+  seqStatus_t status = SEQ_OK;
+
+  if (delta == 1) {
+
+    // in sequence - check for a stall in delivery, which is not
+    // the network's if the pulse had been waiting for us
+
+    bool delayedByUs;
+    if (_streamReader != NULL) {
+      delayedByUs = _streamReader->getLastFromBacklog();
+    } else {
+      delayedByUs = (lag > INGEST_LAG_SECS);
+    }
+    double arrivalGap = now - state.arrivalTime;
+    double pulseGap = pulseTime - state.pulseTime;
+    if (!delayedByUs &&
+        arrivalGap > NETWORK_STALL_SECS && pulseGap < arrivalGap / 2) {
+      _nNetworkStalls++;
+    }
+
+  } else if (delta == 0) {
+
+    _nDuplicates++;
+    return SEQ_DUPLICATE;
+
+  } else if (delta > SEQ_RESET_JUMP || delta < -SEQ_RESET_JUMP) {
+
+    // server restarted, or a new stream - start again. The
+    // block is broken, as for a gap, but nothing is counted lost.
+
+    _nSeqResets++;
+    status = SEQ_RESET;
+    if (_debugLevel > 0) {
+      cerr << "WARNING - AScopeReader: pulse sequence reset, radarId "
+           << radarId << ", jump " << delta << endl;
+    }
+
+  } else if (delta > 1) {
+
+    _nSeqGaps++;
+    _nPulsesMissed += delta - 1;
+    if (lag > INGEST_LAG_SECS) {
+      _nIngestGaps++;
+    } else {
+      _nUpstreamGaps++;
+    }
+    status = SEQ_GAP;
+    if (_debugLevel > 0) {
+      cerr << "WARNING - AScopeReader: pulse sequence gap, radarId "
+           << radarId << ", missed " << delta - 1
+           << ", lag " << lag << " secs" << endl;
+    }
+
+  } else {
+
+    // late pulse - keep the sequence at the newest seen
+
+    _nReorders++;
+    return SEQ_REORDER;
+
+  }
+
+  state.seqNum = seqNum;
+  state.pulseTime = pulseTime;
+  state.arrivalTime = now;
+  return status;
+
+}
+
+///////////////////////////////////////////////////////
+// forget the sequence state, e.g. on reconnect
+
+void AScopeReader::_resetSequence()
+
+{
+  _seqStates.clear();
+  _minLatency = 0.0;
+}
+
+///////////////////////////////////////////////////////
+// print ingest statistics
+
+void AScopeReader::printStats(ostream &out) const
+
+{
+
+  out << "AScopeReader stats:" << endl;
+  out << "  nPulses: " << _pulseCount << endl;
+  out << "  nReconnects: " << _nReconnects << endl;
+  out << "  nReadErrors: " << _nReadErrors << endl;
+  out << "  nBytesSkipped: " << getNBytesSkipped() << endl;
+  if (_streamReader != NULL) {
+    out << "  nResyncs: " << _streamReader->getNResyncs() << endl;
+    out << "  nDecodeErrors: "
+        << _streamReader->getNDecodeErrors() << endl;
+  }
+  const CompressedTsReader *compressedReader =
+    dynamic_cast<const CompressedTsReader *>(_pulseReader);
+  if (compressedReader != NULL) {
+    out << "  decode usecs/packet: "
+        << compressedReader->getDecodeUsecsPerPacket() << endl;
+  }
+  out << "  nSeqGaps: " << _nSeqGaps << endl;
+  out << "    from ingest lag: " << _nIngestGaps << endl;
+  out << "    from upstream: " << _nUpstreamGaps << endl;
+  out << "  nPulsesMissed: " << _nPulsesMissed << endl;
+  out << "  nDuplicates: " << _nDuplicates << endl;
+  out << "  nReorders: " << _nReorders << endl;
+  out << "  nSeqResets: " << _nSeqResets << endl;
+  out << "  nNetworkStalls: " << _nNetworkStalls << endl;
+
+}
+
 ///////////////////////////////////////////////////////
 // get next pulse
 //
@@ -202,22 +707,36 @@ IwrfTsPulse *AScopeReader::_getNextPulse()
 
 {
   
-  IwrfTsPulse *pulse = NULL;
-  
-  while (pulse == NULL) {
-    pulse = _pulseReader->getNextPulse(true);
-    if (pulse == NULL) {
-      if (_pulseReader->getTimedOut()) {
-	// No data yet; return to event loop
-	return NULL;
-      }
-      if (_pulseReader->endOfFile()) {
-	cout << "# NOTE: end of file encountered" << endl;
+  // hold off while backing off after a failure
+
+  if (_backoffMsecs > 0 && _sinceLastFailure.elapsed() < _backoffMsecs) {
+    return NULL;
+  }
+
+  IwrfTsPulse *pulse = _pulseReader->getNextPulse(true);
+  if (pulse == NULL) {
+    if (_pulseReader->getTimedOut()) {
+      // No data yet; check for a stalled connection
+      if (_stallSecs > 0 &&
+          _sinceLastPulse.elapsed() > _stallSecs * 1000.0) {
+        _reconnect("no data received within stall timeout");
       }
+      // return to event loop
       return NULL;
     }
+    if (_pulseReader->endOfFile()) {
+      cout << "# NOTE: end of file encountered" << endl;
+    }
+    // read failed - the server has gone away. Damaged packets
+    // are skipped by the stream readers and do not get here.
+    _nReadErrors++;
+    _reconnect("read failed");
+    return NULL;
   }
 
+  _backoffMsecs = 0;
+  _sinceLastPulse.restart();
+
   if (_pulseReader->endOfFile()) {
     cout << "# NOTE: end of file encountered" << endl;
   }
@@ -267,6 +786,22 @@ void AScopeReader::_sendDataToAScope()
     }
   } // ii
 
+  // start a history row - _loadTs adds the pulse power
+
+  if (_history) {
+    const IwrfTsPulse *first = NULL;
+    if (_pulses.size() > 0) {
+      first = _pulses[0];
+    } else if (_pulsesV.size() > 0) {
+      first = _pulsesV[0];
+    }
+    double rowTime = 0.0;
+    if (first != NULL) {
+      rowTime = first->getFTime();
+    }
+    _history->beginRow(rowTime, nGates);
+  }
+
   if (_channelMode == CHANNEL_MODE_HV_SIM) {
 
     // load H chan 0, send to scope
@@ -377,8 +912,28 @@ void AScopeReader::_sendDataToAScope()
     
   }
 
+  // complete the history row
+
+  if (_history) {
+    _history->endRow();
+    RangeTimeHistory::row_t row;
+    _history->getRow(_history->getNRows() - 1, row);
+    emit historyRowAdded(row);
+  }
+
   // free up the pulses
   
+  _freePulses();
+
+}
+
+///////////////////////////////////////////////////////
+// free the pulses in the current block
+
+void AScopeReader::_freePulses()
+
+{
+
   for (size_t ii = 0; ii < _pulses.size(); ii++) {
     delete _pulses[ii];
   }
@@ -404,9 +959,23 @@ int AScopeReader::_loadTs(int nGates,
 
   if (pulses.size() < 2) return -1;
 
+  // reduce to a min/max envelope if the beam is much
+  // wider than the display - the same gates for every pulse
+
+  int nCols = 0;
+  if (_decimateWidth > 0 && nGates > 2 * _decimateWidth) {
+    nCols = _decimateWidth;
+    _iqFull.resize(nGates * 2);
+    _chooseEnvelopeGates(nGates, channelIn, pulses, nCols);
+  }
+  int nGatesOut = nGates;
+  if (nCols > 0) {
+    nGatesOut = nCols * 2;
+  }
+
   // set header
 
-  ts.gates = nGates;
+  ts.gates = nGatesOut;
   ts.chanId = channelOut;
   ts.sampleRateHz = 1.0 / pulses[0]->get_prt();
   
@@ -427,7 +996,11 @@ int AScopeReader::_loadTs(int nGates,
     const IwrfTsPulse* pulse = pulses[ii];
     int nGatesPulse = pulse->getNGates();
     
-    fl32 *iq = new fl32[nGates * 2];
+    fl32 *iqOut = new fl32[nGatesOut * 2];
+    fl32 *iq = iqOut;
+    if (nCols > 0) {
+      iq = &_iqFull[0];
+    }
     memset(iq, 0, nGates * 2 * sizeof(fl32));
     if (channelIn == 0) {
       if (pulse->getIq0()) {
@@ -438,13 +1011,86 @@ int AScopeReader::_loadTs(int nGates,
         memcpy(iq, pulse->getIq1(), nGatesPulse * 2 * sizeof(fl32));
       }
     }
-    ts.IQbeams.push_back(iq);
+    if (_history && (channelIn == 0 || pulse->getIq1())) {
+      _history->addPulse(channelOut, iq, nGates);
+    }
+    if (nCols > 0) {
+      for (int igate = 0; igate < nGatesOut; igate++) {
+        int gate = _envGates[igate];
+        iqOut[igate * 2] = iq[gate * 2];
+        iqOut[igate * 2 + 1] = iq[gate * 2 + 1];
+      }
+    }
+    ts.IQbeams.push_back(iqOut);
     
   } // ii
 
   return 0;
   
 }
+
+///////////////////////////////////////////////
+// choose the gates for a min/max power envelope of a block
+//
+// The gates are split into nCols equal columns. For each column
+// the gates of minimum and maximum power, summed over all pulses
+// in the block, are kept in gate order, so that peaks survive.
+// Every pulse is then reduced with the same gates, so that each
+// output gate is one range gate through the block - the time
+// series, I vs Q and spectra stay valid.
+// Sets _envGates to nCols * 2 gates.
+
+void AScopeReader::_chooseEnvelopeGates(int nGates,
+                                        int channelIn,
+                                        const vector<IwrfTsPulse *> &pulses,
+                                        int nCols)
+
+{
+
+  // power per gate, summed over the block - simple loops
+  // the compiler can vectorize
+
+  _power.assign(nGates, 0.0);
+  fl32 *power = &_power[0];
+  for (size_t ii = 0; ii < pulses.size(); ii++) {
+    const IwrfTsPulse* pulse = pulses[ii];
+    const fl32 *iq = (channelIn == 0 ? pulse->getIq0() : pulse->getIq1());
+    if (iq == NULL) {
+      continue;
+    }
+    int nGatesPulse = pulse->getNGates();
+    for (int igate = 0; igate < nGatesPulse; igate++) {
+      fl32 ival = iq[igate * 2];
+      fl32 qval = iq[igate * 2 + 1];
+      power[igate] += ival * ival + qval * qval;
+    }
+  }
+
+  // min and max power in each column
+
+  _envGates.resize(nCols * 2);
+  for (int icol = 0; icol < nCols; icol++) {
+
+    int startGate = (int) (((long) icol * nGates) / nCols);
+    int endGate = (int) (((long) (icol + 1) * nGates) / nCols);
+
+    int minGate = startGate;
+    int maxGate = startGate;
+    for (int igate = startGate + 1; igate < endGate; igate++) {
+      if (power[igate] < power[minGate]) {
+        minGate = igate;
+      }
+      if (power[igate] > power[maxGate]) {
+        maxGate = igate;
+      }
+    }
+
+    _envGates[icol * 2] = min(minGate, maxGate);
+    _envGates[icol * 2 + 1] = max(minGate, maxGate);
+
+  } // icol
+
+}
     
 ///////////////////////////////////////////////
 // load up burst data
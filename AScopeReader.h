@@ -26,8 +26,12 @@
 
 #include <QObject>
 #include <QMetaType>
+#include <QElapsedTimer>
+#include <QAtomicInt>
 
 #include <string>
+#include <map>
+#include <iostream>
 #include <toolsa/Socket.hh>
 #include <toolsa/MemBuf.hh>
 #include <radar/iwrf_data.h>
@@ -37,11 +41,21 @@
 #include <radar/IwrfTsReader.hh>
 
 #include "AScope.h"
+#include "RangeTimeHistory.h"
+#include "CompressedTsReader.h"
+#include "IwrfStreamReader.h"
 
 /// A Time series reader for the AScope. It reads IWRF data and translates
 /// DDS samples to AScope::TimeSeries.
+///
+/// The reader can be moved to its own thread, so that ingest is not
+/// held up by drawing. Apart from setBlockSize(), methods must then
+/// be called from that thread, or once it has finished. The
+/// range-time history reaches other threads as row copies, through
+/// historyRowAdded().
 
 Q_DECLARE_METATYPE(AScope::TimeSeries)
+Q_DECLARE_METATYPE(RangeTimeHistory::row_t)
   
 class AScopeReader : public QObject
 {
@@ -54,16 +68,112 @@ public:
   /// @param host The server host
   /// @param port The server port
   /// @param fmqPath - set in FMQ mode
+  /// @param pulseReader - if not NULL, pulses are read from this
+  /// instead of the server, e.g. a synthetic source for testing.
+  /// The AScopeReader takes ownership of it.
     AScopeReader(const std::string &host, int port,
                  const std::string &fmqPath,
                  bool simulMode,
                  AScope &scope, 
                  int radarId,
                  int burstChan,
-                 int debugLevel);
+                 int debugLevel,
+                 IwrfTsReader *pulseReader = NULL);
 
   /// Destructor
   virtual ~AScopeReader();
+
+  /// Action taken when a pulse sequence gap or reset is found
+  /// inside a block. With an action set, late (out of order)
+  /// pulses are dropped so that blocks stay in sequence.
+  typedef enum {
+    GAP_ACTION_NONE,    ///< keep the pulses, just count the gap
+    GAP_ACTION_DISCARD, ///< drop the pulses before the gap
+    GAP_ACTION_SPLIT    ///< send the pulses before the gap as a short block
+  } gapAction_t;
+
+  /// Set the action for pulse sequence gaps.
+  void setGapAction(gapAction_t action) { _gapAction = action; }
+
+  /// Read the compressed stream from tsrelay, instead of raw
+  /// IWRF, from the server host and port.
+  void setCompressed(bool compressed);
+
+  /// Set the stall timeout. If no pulse arrives for this many
+  /// seconds the connection is torn down and re-opened.
+  /// Off by default, since a quiet radar is not a fault.
+  /// @param secs Timeout in seconds, 0 to disable.
+  void setStallSecs(double secs) { _stallSecs = secs; }
+
+  /// Set the display width for decimation. Beams with more than
+  /// twice this many gates are reduced to a min/max power envelope,
+  /// two gates per display column, before being sent to the scope.
+  /// The gates are chosen once per block, from the block power.
+  /// @param width Output width in columns, 0 for full resolution.
+  void setDecimateWidth(int width) { _decimateWidth = width; }
+
+  /// Keep a range-time history of block mean power.
+  /// @param maxRows Number of blocks retained, 0 to disable
+  /// @param maxGates Number of range bins per block
+  /// @param maxAgeSecs Drop blocks older than this, 0 for no limit
+  void setHistory(int maxRows, int maxGates, double maxAgeSecs);
+
+  /// Report timer jitter of the ingest loop - how late each timer
+  /// tick starts, after its deadline or after the previous tick
+  /// finished, whichever is later.
+  /// @param secs Report interval in seconds, 0 to disable
+  void setJitterReportSecs(double secs) { _jitterReportSecs = secs; }
+
+  /// Ask for huge pages to back the range-time history. Call
+  /// before setHistory() - the advice is given as it allocates.
+  void setHugePages(bool hugePages) { _hugePages = hugePages; }
+
+  /// Lock the long-lived buffers in memory - the range-time
+  /// history and the stream input buffer, now and whenever they
+  /// are re-created.
+  /// @return 0 on success, -1 if any could not be locked
+  int lockBuffers(std::string &errStr);
+
+  /// Set the number of pulses per block. Safe to call from
+  /// any thread, e.g. the GUI thread following the scope.
+  void setBlockSize(int nSamples) { _blockSize.storeRelease(nSamples); }
+
+  /// Read available data, and send a block to the scope if
+  /// one is complete. Called on each timer tick.
+  void pollData();
+
+  /// @return the range-time history, or NULL if not enabled.
+  /// The ring is overwritten as blocks arrive - use it only on
+  /// the reader's thread, and historyRowAdded() elsewhere.
+  const RangeTimeHistory *getHistory() const { return _history; }
+
+  /// @return the number of times the reader has reconnected
+  int getNReconnects() const { return _nReconnects; }
+
+  /// @return the number of failed reads from the server
+  int getNReadErrors() const { return _nReadErrors; }
+
+  /// @return bytes skipped resynchronising a damaged stream.
+  /// Not available for FMQ.
+  si64 getNBytesSkipped() const;
+
+  /// @return the number of pulse sequence gaps
+  int getNSeqGaps() const { return _nSeqGaps; }
+
+  /// @return the number of pulses missing from sequence gaps
+  si64 getNPulsesMissed() const { return _nPulsesMissed; }
+
+  /// @return the number of duplicate pulses dropped
+  int getNDuplicates() const { return _nDuplicates; }
+
+  /// @return the number of out-of-order pulses
+  int getNReorders() const { return _nReorders; }
+
+  /// @return the number of large jumps in pulse sequence
+  int getNSeqResets() const { return _nSeqResets; }
+
+  /// Print the ingest statistics
+  void printStats(std::ostream &out) const;
   
   signals:
 
@@ -74,12 +184,21 @@ public:
     
   void newItem(AScope::TimeSeries pItem);
 
+  /// Emitted when a row has been added to the range-time history.
+  /// @param row A copy of the new row, safe to use on any thread.
+
+  void historyRowAdded(RangeTimeHistory::row_t row);
+
 public slots:
 
   /// Use this slot to return an item
   /// @param pItem the item to be returned.
 
   void returnItemSlot(AScope::TimeSeries pItem);
+
+  /// Stop reading - call in the reader's thread before it quits.
+
+  void stop();
   
   // respond to timer events
   
@@ -103,13 +222,93 @@ private:
   // read in data
 
   IwrfTsReader *_pulseReader;
+  StreamTsReader *_streamReader; // _pulseReader, if on a TCP stream
+  bool _externalReader; // supplied by caller, cannot be re-created
+  bool _compressed; // reading from tsrelay
+  bool _lockBuffers;
+  bool _hugePages;
   bool _haveChan1;
   int _dataTimerId;
 
+  // reconnect handling - on a read error or a stall the reader
+  // is re-created, with exponential backoff between attempts
+
+  static const int MIN_BACKOFF_MSECS = 100;
+  static const int MAX_BACKOFF_MSECS = 5000;
+  double _stallSecs;
+  int _backoffMsecs;
+  QElapsedTimer _sinceLastPulse;
+  QElapsedTimer _sinceLastFailure;
+  int _nReconnects;
+  int _nReadErrors;
+  si64 _nBytesSkippedPrev; // from readers since replaced
+
+  // ingest loop jitter - lateness of each timer tick, kept in a
+  // fixed ring of samples. Time in our own handler is not counted:
+  // a tick cannot start before the previous one has finished, so
+  // lateness runs from its deadline or the end of the previous
+  // tick, whichever is later.
+
+  static const int DATA_TIMER_MSECS = 50;
+  static const int MAX_JITTER_SAMPLES = 1200;
+  double _jitterReportSecs;
+  bool _haveTick; // first tick has no deadline to measure from
+  QElapsedTimer _jitterClock;
+  double _tickDeadlineMsecs;
+  double _tickEndMsecs;
+  QElapsedTimer _sinceJitterReport;
+  vector<double> _jitterMsecs;
+  int _jitterIndex;
+
   // pulse stats
 
+  QAtomicInt _blockSize; // set from the GUI thread
   int _nSamples;
   int _pulseCount;
+
+  // pulse sequence tracking, per radar id.
+  //
+  // Gaps are attributed to our own ingest if the pulse latency,
+  // relative to the lowest seen, exceeds INGEST_LAG_SECS when the
+  // gap is found - i.e. we had fallen behind and the server
+  // dropped pulses for us. Otherwise the loss is upstream.
+  // A long wait between pulses with no gap in the sequence, and
+  // little change in pulse time, is counted as a network stall -
+  // unless the pulse was already waiting to be read, in which
+  // case the delay was ours. Readers that cannot tell us that
+  // use the ingest lag instead.
+
+  static const double INGEST_LAG_SECS;
+  static const double NETWORK_STALL_SECS;
+  static const si64 SEQ_RESET_JUMP = 1000000;
+
+  typedef enum {
+    SEQ_OK,
+    SEQ_GAP,
+    SEQ_RESET,     // large jump, e.g. server restart
+    SEQ_DUPLICATE,
+    SEQ_REORDER
+  } seqStatus_t;
+
+  typedef struct {
+    si64 seqNum;
+    double pulseTime;
+    double arrivalTime;
+  } seqState_t;
+
+  std::map<int, seqState_t> _seqStates;
+  double _minLatency;
+  gapAction_t _gapAction;
+  IwrfTsPulse *_pendingPulse; // first pulse after a split
+
+  int _nSeqGaps;
+  si64 _nPulsesMissed;
+  int _nDuplicates;
+  int _nReorders;
+  int _nSeqResets;
+  int _nIngestGaps;
+  int _nUpstreamGaps;
+  int _nNetworkStalls;
   
   // info and pulses
 
@@ -125,15 +324,34 @@ private:
   } channelMode_t;
   channelMode_t _channelMode;
 
+  // display decimation
+
+  int _decimateWidth;
+  vector<fl32> _iqFull;
+  vector<fl32> _power;
+  vector<int> _envGates; // gates kept, for the current block
+
+  // range-time history, NULL if not enabled
+
+  RangeTimeHistory *_history;
+
   // sequence number for time series to ascope
 
   size_t _tsSeqNum;
 
   // methods
   
+  void _updateJitter();
+  void _reportJitter();
+  void _createPulseReader();
+  int _lockReaderBuffers(std::string &errStr);
+  void _reconnect(const std::string &reason);
   int _readData();
   IwrfTsPulse *_getNextPulse();
+  seqStatus_t _checkSequence(const IwrfTsPulse *pulse);
+  void _resetSequence();
   void _sendDataToAScope();
+  void _freePulses();
   int _loadTs(int nGates,
               int channelIn,
               const vector<IwrfTsPulse *> &pulses,
@@ -142,6 +360,10 @@ private:
   int _loadBurst(const IwrfTsBurst &burst,
                  int channelOut,
                  AScope::FloatTimeSeries &ts);
+  void _chooseEnvelopeGates(int nGates,
+                            int channelIn,
+                            const vector<IwrfTsPulse *> &pulses,
+                            int nCols);
 
 };
 
@@ -0,0 +1,1112 @@
+// *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* 
+// ** Copyright UCAR (c) 1990 - 2016                                         
+// ** University Corporation for Atmospheric Research (UCAR)                 
+// ** National Center for Atmospheric Research (NCAR)                        
+// ** Boulder, Colorado, USA                                                 
+// ** BSD licence applies - redistribution and use in source and binary      
+// ** forms, with or without modification, are permitted provided that       
+// ** the following conditions are met:                                      
+// ** 1) If the software is modified to produce derivative works,            
+// ** such modified software should be clearly marked, so as not             
+// ** to confuse it with the version available from UCAR.                    
+// ** 2) Redistributions of source code must retain the above copyright      
+// ** notice, this list of conditions and the following disclaimer.          
+// ** 3) Redistributions in binary form must reproduce the above copyright   
+// ** notice, this list of conditions and the following disclaimer in the    
+// ** documentation and/or other materials provided with the distribution.   
+// ** 4) Neither the name of UCAR nor the names of its contributors,         
+// ** if any, may be used to endorse or promote products derived from        
+// ** this software without specific prior written permission.               
+// ** DISCLAIMER: THIS SOFTWARE IS PROVIDED "AS IS" AND WITHOUT ANY EXPRESS  
+// ** OR IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED      
+// ** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.    
+// *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* 
+/*
+ * AScopeReaderTest.cpp
+ *
+ * Regression tests and microbenchmarks for AScopeReader block
+ * assembly. Pulses come from a synthetic IwrfTsReader, so no
+ * server is needed. Run under the offscreen platform:
+ *
+ *   QT_QPA_PLATFORM=offscreen ./AScopeReaderTest [--bench]
+ */
+
+#include <QApplication>
+#include <QElapsedTimer>
+
+#include <iostream>
+#include <fstream>
+#include <deque>
+#include <map>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <boost/program_options.hpp>
+#include <toolsa/ServerSocket.hh>
+#include <toolsa/uusleep.h>
+#include "AScopeReader.h"
+#include "CompressedTs.h"
+#include "CompressedTsReader.h"
+#include "IwrfStreamReader.h"
+#include "ThreadTuning.h"
+#include "AScope.h"
+
+using namespace std;
+namespace po = boost::program_options;
+
+//////////////////////////////////////////////////////////////////////
+/// Synthetic pulse source. Pulses are generated up front and
+/// handed out in order; when the queue is empty the reader
+/// reports a timeout, as a live server with no data would.
+///
+/// IQ values encode where they came from, so that the channel
+/// mapping can be checked on the far side of the reader:
+///   I = 10000 * (V pulse ? 1 : 0) + 1000 * channel + gate
+///   Q = index of the pulse in its H or V stream
+/// With a moving peak, Q is instead large at one gate, which
+/// moves from pulse to pulse, and zero elsewhere.
+
+class SyntheticTsReader : public IwrfTsReader
+{
+
+public:
+
+  typedef enum {
+    STREAM_SINGLE_POL,
+    STREAM_SIMULTANEOUS,
+    STREAM_ALTERNATING
+  } stream_t;
+
+  SyntheticTsReader() :
+          _seqNum(0),
+          _nH(0),
+          _nV(0),
+          _movingPeak(false)
+  {
+    _timedOut = false;
+  }
+
+  virtual ~SyntheticTsReader()
+  {
+    for (size_t ii = 0; ii < _queue.size(); ii++) {
+      delete _queue[ii];
+    }
+  }
+
+  /// Queue pulses
+  /// @param nPulses Number of pulses
+  /// @param nGates Gates per pulse
+  /// @param gateStep If non-zero, pulse ii has nGates - (ii % 4) * gateStep
+  /// @param nullEvery If non-zero, every nullEvery'th pulse has no IQ
+  void addPulses(stream_t stream, int nPulses, int nGates,
+                 int gateStep = 0, int nullEvery = 0)
+  {
+    int nChannels = (stream == STREAM_SINGLE_POL ? 1 : 2);
+    vector<fl32> iq;
+    for (int ii = 0; ii < nPulses; ii++) {
+      bool isV = (stream == STREAM_ALTERNATING && (ii % 2) == 1);
+      int nGatesPulse = nGates - (ii % 4) * gateStep;
+      int index = (isV ? _nV++ : _nH++);
+      IwrfTsPulse *pulse = new IwrfTsPulse(_info);
+      pulse->setTime(1500000000 + _seqNum / 1000,
+                     (int) (_seqNum % 1000) * 1000000);
+      pulse->set_pulse_seq_num(_seqNum++);
+      pulse->set_prt(0.001);
+      pulse->set_hv_flag(isV ? 0 : 1);
+      if (nullEvery == 0 || ((ii + 1) % nullEvery) != 0) {
+        iq.resize(nGatesPulse * nChannels * 2);
+        for (int ichan = 0; ichan < nChannels; ichan++) {
+          fl32 *chanIq = &iq[ichan * nGatesPulse * 2];
+          for (int igate = 0; igate < nGatesPulse; igate++) {
+            chanIq[igate * 2] = (isV ? 10000 : 0) + 1000 * ichan + igate;
+            if (_movingPeak) {
+              int peakGate = (index * 37) % nGatesPulse;
+              chanIq[igate * 2 + 1] = (igate == peakGate ? 1.0e5 : 0);
+            } else {
+              chanIq[igate * 2 + 1] = index;
+            }
+          }
+        }
+        pulse->setIqFloats(nGatesPulse, nChannels, &iq[0]);
+      }
+      _queue.push_back(pulse);
+    }
+  }
+
+  /// Put the power peak at a different gate in each pulse
+  void setMovingPeak(bool movingPeak) { _movingPeak = movingPeak; }
+
+  /// Skip sequence numbers, to simulate lost pulses
+  void skipPulses(int nPulses) { _seqNum += nPulses; }
+
+  /// Set the burst, I = 20000 + sample, Q = 0
+  void setBurst(int nSamples)
+  {
+    vector<fl32> iq(nSamples * 2);
+    for (int ii = 0; ii < nSamples; ii++) {
+      iq[ii * 2] = 20000 + ii;
+      iq[ii * 2 + 1] = 0;
+    }
+    _burst.setSamplingFreqHz(1.0e8);
+    _burst.setIqFloats(nSamples, &iq[0]);
+  }
+
+  size_t getNQueued() const { return _queue.size(); }
+
+  virtual IwrfTsPulse *getNextPulse(bool convertToFloat = false)
+  {
+    if (_queue.empty()) {
+      _timedOut = true;
+      return NULL;
+    }
+    _timedOut = false;
+    IwrfTsPulse *pulse = _queue.front();
+    _queue.pop_front();
+    return pulse;
+  }
+
+  virtual void reset() {}
+  virtual void seekToStart() {}
+  virtual void seekToEnd() {}
+
+private:
+
+  IwrfTsInfo _info;
+  deque<IwrfTsPulse *> _queue;
+  si64 _seqNum;
+  int _nH;
+  int _nV;
+  bool _movingPeak;
+
+};
+
+//////////////////////////////////////////////////////////////////////
+/// Collects the time series sent by a reader, copying the beams
+/// of the latest item in each channel, and returns the items.
+
+class Collector
+{
+
+public:
+
+  typedef struct {
+    int nItems;
+    int gates;
+    size_t nBeams;
+    vector<fl32> first;
+    vector<fl32> last;
+    vector< vector<fl32> > beams;
+  } chan_t;
+
+  Collector(AScopeReader &reader, bool keepData) :
+          _reader(reader),
+          _keepData(keepData),
+          nItems(0)
+  {
+    QObject::connect(&reader, &AScopeReader::newItem,
+                     [this](AScope::TimeSeries ts) { _receive(ts); });
+  }
+
+  void clear() { chans.clear(); nItems = 0; }
+
+  map<int, chan_t> chans;
+  int nItems;
+
+private:
+
+  AScopeReader &_reader;
+  bool _keepData;
+
+  void _receive(AScope::TimeSeries ts)
+  {
+    nItems++;
+    if (_keepData) {
+      chan_t &chan = chans[ts.chanId];
+      chan.nItems++;
+      chan.gates = ts.gates;
+      chan.nBeams = ts.IQbeams.size();
+      const fl32 *first = (const fl32 *) ts.IQbeams.front();
+      const fl32 *last = (const fl32 *) ts.IQbeams.back();
+      chan.first.assign(first, first + ts.gates * 2);
+      chan.last.assign(last, last + ts.gates * 2);
+      chan.beams.resize(ts.IQbeams.size());
+      for (size_t ii = 0; ii < ts.IQbeams.size(); ii++) {
+        const fl32 *beam = (const fl32 *) ts.IQbeams[ii];
+        chan.beams[ii].assign(beam, beam + ts.gates * 2);
+      }
+    }
+    _reader.returnItemSlot(ts);
+  }
+
+};
+
+//////////////////////////////////////////////////////////////////////
+// test helpers
+
+static int _nFailed = 0;
+static int _nPassed = 0;
+
+static void check(bool ok, const string &test, const string &what)
+{
+  if (ok) {
+    _nPassed++;
+  } else {
+    _nFailed++;
+    cout << "FAIL " << test << ": " << what << endl;
+  }
+}
+
+// check the I value at a gate encodes the expected source
+
+static bool ivalIs(const Collector::chan_t &chan, int gate, fl32 expected)
+{
+  if ((int) chan.first.size() < (gate + 1) * 2) {
+    return false;
+  }
+  return chan.first[gate * 2] == expected;
+}
+
+// write a block of dual channel IWRF pulses to a client, with
+// I = 1000 * channel + gate and Q = sequence number
+
+static void sendRawBlock(Socket *client, int blockSize, int firstSeq)
+{
+  int nGates = 16;
+  IwrfTsInfo info;
+  vector<fl32> iq(nGates * 4);
+  MemBuf packet;
+  for (int ii = 0; ii < blockSize; ii++) {
+    int seq = firstSeq + ii;
+    for (int ichan = 0; ichan < 2; ichan++) {
+      for (int igate = 0; igate < nGates; igate++) {
+        iq[(ichan * nGates + igate) * 2] = 1000 * ichan + igate;
+        iq[(ichan * nGates + igate) * 2 + 1] = seq;
+      }
+    }
+    IwrfTsPulse pulse(info);
+    pulse.set_pulse_seq_num(seq);
+    pulse.set_prt(0.001);
+    pulse.setIqFloats(nGates, 2, &iq[0]);
+    pulse.assemble(packet);
+    client->writeBuffer(packet.getPtr(), packet.getLen(), 1000);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////
+// tests
+
+static void testSinglePol(AScope &scope)
+{
+  string test = "singlePol";
+  int blockSize = scope.getBlockSize();
+  SyntheticTsReader *source = new SyntheticTsReader;
+  source->addPulses(SyntheticTsReader::STREAM_SINGLE_POL, blockSize, 100);
+  AScopeReader reader("", 0, "", false, scope, 0, -1, 0, source);
+  Collector coll(reader, true);
+  reader.pollData();
+  check(coll.chans.count(0) == 1, test, "no chan 0");
+  check(coll.chans.count(2) == 0, test, "unexpected burst chan");
+  const Collector::chan_t &chan0 = coll.chans[0];
+  check(chan0.gates == 100, test, "wrong gates");
+  check((int) chan0.nBeams == blockSize, test, "wrong beam count");
+  check(ivalIs(chan0, 7, 7), test, "chan 0 data");
+  check(chan0.last[1] == blockSize - 1, test, "pulse order");
+}
+
+static void testSimultaneous(AScope &scope)
+{
+  string test = "simultaneous";
+  int blockSize = scope.getBlockSize();
+  SyntheticTsReader *source = new SyntheticTsReader;
+  source->addPulses(SyntheticTsReader::STREAM_SIMULTANEOUS, blockSize, 50);
+  AScopeReader reader("", 0, "", true, scope, 0, -1, 0, source);
+  Collector coll(reader, true);
+  reader.pollData();
+  check(coll.chans.count(0) && coll.chans.count(1), test, "missing chans");
+  check(ivalIs(coll.chans[0], 3, 3), test, "chan 0 data");
+  check(ivalIs(coll.chans[1], 3, 1003), test, "chan 1 data");
+}
+
+static void testAlternating(AScope &scope, int burstChan)
+{
+  string test = "alternating";
+  if (burstChan >= 0) {
+    test += "_burstChan" + to_string(burstChan);
+  }
+  int blockSize = scope.getBlockSize();
+  SyntheticTsReader *source = new SyntheticTsReader;
+  source->addPulses(SyntheticTsReader::STREAM_ALTERNATING,
+                    blockSize * 2, 40);
+  source->setBurst(16);
+  AScopeReader reader("", 0, "", false, scope, 0, burstChan, 0, source);
+  Collector coll(reader, true);
+  reader.pollData();
+  check(coll.chans.size() == 4, test, "expected 4 chans");
+  // H co, V co, V cross (from H chan 1), H cross (from V chan 1)
+  fl32 expected[4] = { 0, 10000, 11000, 1000 };
+  for (int ichan = 0; ichan < 4; ichan++) {
+    const Collector::chan_t &chan = coll.chans[ichan];
+    string chanStr = "chan " + to_string(ichan);
+    if (ichan == burstChan) {
+      check(chan.gates == 16, test, chanStr + " burst gates");
+      check(ivalIs(chan, 5, 20005), test, chanStr + " burst data");
+    } else {
+      check((int) chan.nBeams == blockSize, test, chanStr + " beams");
+      check(ivalIs(chan, 5, expected[ichan] + 5), test, chanStr + " data");
+    }
+  }
+}
+
+static void testUnevenGates(AScope &scope)
+{
+  string test = "unevenGates";
+  int blockSize = scope.getBlockSize();
+  SyntheticTsReader *source = new SyntheticTsReader;
+  source->addPulses(SyntheticTsReader::STREAM_SIMULTANEOUS,
+                    blockSize, 200, 10);
+  AScopeReader reader("", 0, "", true, scope, 0, -1, 0, source);
+  Collector coll(reader, true);
+  reader.pollData();
+  const Collector::chan_t &chan1 = coll.chans[1];
+  check(chan1.gates == 200, test, "gates should be the maximum");
+  // last pulse is short by (blockSize - 1) % 4 * 10 gates, zero padded
+  int nShort = ((blockSize - 1) % 4) * 10;
+  if (nShort > 0) {
+    check(chan1.last[(199) * 2] == 0, test, "padding not zero");
+  }
+  check(chan1.last[(199 - nShort) * 2] == 1000 + 199 - nShort,
+        test, "data before padding");
+}
+
+static void testNullIq(AScope &scope)
+{
+  string test = "nullIq";
+  int blockSize = scope.getBlockSize();
+  SyntheticTsReader *source = new SyntheticTsReader;
+  // every 3rd pulse has no IQ, so 1.5 blocks gives one full block
+  source->addPulses(SyntheticTsReader::STREAM_SINGLE_POL,
+                    (blockSize * 3) / 2 + 3, 20, 0, 3);
+  AScopeReader reader("", 0, "", false, scope, 0, -1, 0, source);
+  Collector coll(reader, true);
+  reader.pollData();
+  check(coll.chans.count(0) == 1, test, "no block sent");
+  check((int) coll.chans[0].nBeams == blockSize, test, "wrong beam count");
+}
+
+static void testSequenceSplit(AScope &scope)
+{
+  string test = "sequenceSplit";
+  int blockSize = scope.getBlockSize();
+  int nBefore = blockSize / 2;
+  SyntheticTsReader *source = new SyntheticTsReader;
+  source->addPulses(SyntheticTsReader::STREAM_SINGLE_POL, nBefore, 20);
+  source->skipPulses(5);
+  source->addPulses(SyntheticTsReader::STREAM_SINGLE_POL, blockSize, 20);
+  AScopeReader reader("", 0, "", false, scope, 0, -1, 0, source);
+  reader.setGapAction(AScopeReader::GAP_ACTION_SPLIT);
+  Collector coll(reader, true);
+  reader.pollData();
+  check(reader.getNSeqGaps() == 1, test, "gap not counted");
+  check(reader.getNPulsesMissed() == 5, test, "missed count");
+  check((int) coll.chans[0].nBeams == nBefore, test, "short block size");
+  coll.clear();
+  reader.pollData();
+  check((int) coll.chans[0].nBeams == blockSize, test, "next block size");
+  check(coll.chans[0].first[1] == nBefore, test, "next block start");
+}
+
+// a late pulse is dropped, leaving the block it arrived in intact
+
+static void testLatePulseDiscard(AScope &scope)
+{
+  string test = "latePulseDiscard";
+  int blockSize = scope.getBlockSize();
+  int nBefore = blockSize / 2;
+  SyntheticTsReader *source = new SyntheticTsReader;
+  source->addPulses(SyntheticTsReader::STREAM_SINGLE_POL, nBefore, 20);
+  source->skipPulses(-3);
+  source->addPulses(SyntheticTsReader::STREAM_SINGLE_POL, 1, 20);
+  source->skipPulses(2);
+  source->addPulses(SyntheticTsReader::STREAM_SINGLE_POL,
+                    blockSize - nBefore, 20);
+  AScopeReader reader("", 0, "", false, scope, 0, -1, 0, source);
+  reader.setGapAction(AScopeReader::GAP_ACTION_DISCARD);
+  Collector coll(reader, true);
+  reader.pollData();
+  check(reader.getNReorders() == 1, test, "reorder not counted");
+  check(coll.chans.count(0) == 1, test, "block lost");
+  check((int) coll.chans[0].nBeams == blockSize, test, "wrong beam count");
+  check(coll.chans[0].first[1] == 0, test, "block start");
+}
+
+// a sequence reset breaks the block like a gap, without counting
+// pulses as lost
+
+static void testSequenceReset(AScope &scope)
+{
+  string test = "sequenceReset";
+  int blockSize = scope.getBlockSize();
+  int nBefore = blockSize / 2;
+  SyntheticTsReader *source = new SyntheticTsReader;
+  source->addPulses(SyntheticTsReader::STREAM_SINGLE_POL, nBefore, 20);
+  source->skipPulses(5000000);
+  source->addPulses(SyntheticTsReader::STREAM_SINGLE_POL, blockSize, 20);
+  AScopeReader reader("", 0, "", false, scope, 0, -1, 0, source);
+  reader.setGapAction(AScopeReader::GAP_ACTION_DISCARD);
+  Collector coll(reader, true);
+  reader.pollData();
+  check(reader.getNSeqResets() == 1, test, "reset not counted");
+  check(reader.getNSeqGaps() == 0, test, "reset counted as a gap");
+  check((int) coll.chans[0].nBeams == blockSize, test, "wrong beam count");
+  check(coll.chans[0].first[1] == nBefore, test, "pulses before reset kept");
+}
+
+static void testDecimation(AScope &scope)
+{
+  string test = "decimation";
+  int blockSize = scope.getBlockSize();
+  SyntheticTsReader *source = new SyntheticTsReader;
+  source->addPulses(SyntheticTsReader::STREAM_SINGLE_POL, blockSize, 1000);
+  AScopeReader reader("", 0, "", false, scope, 0, -1, 0, source);
+  reader.setDecimateWidth(100);
+  Collector coll(reader, true);
+  reader.pollData();
+  const Collector::chan_t &chan0 = coll.chans[0];
+  check(chan0.gates == 200, test, "envelope gates");
+  // power rises with gate, so each column keeps its first and last gate
+  check(ivalIs(chan0, 0, 0) && ivalIs(chan0, 1, 9), test, "first column");
+  check(ivalIs(chan0, 199, 999), test, "peak lost");
+}
+
+// the peak moves between pulses - each output gate must still be
+// the same range gate in every pulse of the block
+
+static void testDecimationMovingPeak(AScope &scope)
+{
+  string test = "decimationMovingPeak";
+  int blockSize = scope.getBlockSize();
+  SyntheticTsReader *source = new SyntheticTsReader;
+  source->setMovingPeak(true);
+  source->addPulses(SyntheticTsReader::STREAM_SINGLE_POL, blockSize, 1000);
+  AScopeReader reader("", 0, "", false, scope, 0, -1, 0, source);
+  reader.setDecimateWidth(100);
+  Collector coll(reader, true);
+  reader.pollData();
+  const Collector::chan_t &chan0 = coll.chans[0];
+  check(chan0.gates == 200, test, "envelope gates");
+  check((int) chan0.beams.size() == blockSize, test, "wrong beam count");
+  bool sameGates = true;
+  bool inOrder = true;
+  for (size_t ii = 0; ii < chan0.beams.size(); ii++) {
+    const vector<fl32> &beam = chan0.beams[ii];
+    for (int igate = 0; igate < chan0.gates; igate++) {
+      if (beam[igate * 2] != chan0.beams[0][igate * 2]) {
+        sameGates = false;
+      }
+      if (igate > 0 && beam[igate * 2] < beam[(igate - 1) * 2]) {
+        inOrder = false;
+      }
+    }
+  }
+  check(sameGates, test, "column to gate mapping differs between pulses");
+  check(inOrder, test, "gates out of order");
+  // the first pulse peaks at gate 0, which is the only gate in its
+  // column with power in any pulse
+  check(chan0.beams[0][1] == 1.0e5, test, "peak lost");
+}
+
+static void testHistory(AScope &scope)
+{
+  string test = "history";
+  int blockSize = scope.getBlockSize();
+  SyntheticTsReader *source = new SyntheticTsReader;
+  source->addPulses(SyntheticTsReader::STREAM_SIMULTANEOUS,
+                    blockSize * 3, 64);
+  AScopeReader reader("", 0, "", true, scope, 0, -1, 0, source);
+  reader.setHistory(2, 16, 0);
+  Collector coll(reader, false);
+  vector<RangeTimeHistory::row_t> rows;
+  QObject::connect(&reader, &AScopeReader::historyRowAdded,
+                   [&rows](RangeTimeHistory::row_t row) {
+                     rows.push_back(row);
+                   });
+  for (int ii = 0; ii < 3; ii++) {
+    reader.pollData();
+  }
+  const RangeTimeHistory *history = reader.getHistory();
+  check(history->getNRows() == 2, test, "ring not bounded");
+  check(history->getRowGateStride(0) == 4, test, "gate stride");
+  check(history->getPower(0, 0) != NULL, test, "chan 0 missing");
+  check(history->getPower(0, 2) == NULL, test, "burst chan has power");
+
+  // each row is sent as a copy, matching the ring
+  check(rows.size() == 3, test, "rows not sent");
+  if (rows.size() == 3) {
+    const RangeTimeHistory::row_t &row = rows[2];
+    check(row.nBins == history->getRowNBins(1), test, "row bins");
+    check((int) row.power[0].size() == row.nBins &&
+          row.power[0][3] == history->getPower(1, 0)[3],
+          test, "row power");
+    check(row.power[2].empty(), test, "row burst chan has power");
+  }
+}
+
+// codec - windowed pulses decode at their own gates, and damaged
+// or oversized headers are rejected
+
+static void testCodec()
+{
+  string test = "codec";
+  IwrfTsInfo info;
+  int nGates = 100;
+  vector<fl32> iq(nGates * 2);
+  for (int igate = 0; igate < nGates; igate++) {
+    iq[igate * 2] = igate;
+    iq[igate * 2 + 1] = -igate;
+  }
+  IwrfTsPulse pulse(info);
+  pulse.setIqFloats(nGates, 1, &iq[0]);
+  vector<ui08> packet;
+  check(CompressedTs::encodePulse(pulse, 40, 20, 16, packet) == 0,
+        test, "encode failed");
+  CompressedTs::decoded_t decoded;
+  check(CompressedTs::decode(&packet[0], packet.size(), decoded) == 0,
+        test, "decode failed");
+  check(decoded.iq.size() == 60 * 2, test, "not padded to start gate");
+  check(decoded.iq[39 * 2] == 0, test, "padding not zero");
+  check(fabs(decoded.iq[45 * 2] - 45) < 0.01, test, "gate moved");
+
+  vector<ui08> damaged(packet);
+  damaged[offsetof(CompressedTs::compressed_ts_hdr_t, raw_bytes) + 3] ^= 0x80;
+  check(CompressedTs::checkHeader(&damaged[0]) != 0, test,
+        "damaged raw_bytes accepted");
+
+  ui08 tail[3] = { 0, 0, 0 };
+  ui32 burstId = CompressedTs::BURST_ID;
+  memcpy(&tail[2], &burstId, 1);
+  check(CompressedTs::findPacketId(tail, 3) == 2, test,
+        "burst id at end of buffer missed");
+}
+
+// compressed stream end to end on localhost, with junk ahead of
+// the first packet to exercise resynchronisation
+
+static void testCompressedStream(AScope &scope)
+{
+  string test = "compressedStream";
+  int port = 17321;
+  ServerSocket server;
+  if (server.openServer(port)) {
+    cout << "SKIP " << test << ": cannot open port " << port << endl;
+    return;
+  }
+
+  CompressedTsReader *source = new CompressedTsReader("localhost", port, 0, 0);
+  AScopeReader reader("", 0, "", true, scope, 0, -1, 0, source);
+  Collector coll(reader, true);
+  reader.pollData(); // connects
+  Socket *client = server.getClient(1000);
+  check(client != NULL, test, "no connection");
+  if (client == NULL) {
+    return;
+  }
+
+  vector<ui08> junk(333, 0x1c);
+  client->writeBuffer(&junk[0], junk.size(), 1000);
+
+  int blockSize = scope.getBlockSize();
+  int nGates = 16;
+  IwrfTsInfo info;
+  vector<fl32> iq(nGates * 4);
+  vector<ui08> packet;
+  for (int ii = 0; ii < blockSize; ii++) {
+    for (int ichan = 0; ichan < 2; ichan++) {
+      for (int igate = 0; igate < nGates; igate++) {
+        iq[(ichan * nGates + igate) * 2] = 1000 * ichan + igate;
+        iq[(ichan * nGates + igate) * 2 + 1] = ii;
+      }
+    }
+    IwrfTsPulse pulse(info);
+    pulse.set_pulse_seq_num(ii);
+    pulse.set_prt(0.001);
+    pulse.setIqFloats(nGates, 2, &iq[0]);
+    CompressedTs::encodePulse(pulse, 0, 0, 16, packet);
+    client->writeBuffer(&packet[0], packet.size(), 1000);
+  }
+
+  for (int ii = 0; ii < 100 && coll.nItems == 0; ii++) {
+    reader.pollData();
+  }
+  check(coll.chans.count(1) == 1, test, "no block received");
+  if (coll.chans.count(1) == 1) {
+    const Collector::chan_t &chan1 = coll.chans[1];
+    check((int) chan1.nBeams == blockSize, test, "wrong beam count");
+    check(fabs(chan1.first[5 * 2] - 1005) < 0.1, test, "chan 1 data");
+  }
+  check(reader.getNBytesSkipped() == 333, test, "bytes skipped");
+
+  client->close();
+  delete client;
+}
+
+// the ingest thread keeps its cpu pinning through compressed
+// decodes - small batches are decoded on it, and it takes part
+// in the parallel ones
+
+static void testDecodeKeepsTuning()
+{
+  string test = "decodeKeepsTuning";
+  int port = 17324;
+
+  cpu_set_t savedCpus;
+  pthread_getaffinity_np(pthread_self(), sizeof(savedCpus), &savedCpus);
+  if (CPU_COUNT(&savedCpus) < 2) {
+    cout << "SKIP " << test << ": needs two cpus" << endl;
+    return;
+  }
+  int pinCpu = 0;
+  while (!CPU_ISSET(pinCpu, &savedCpus)) {
+    pinCpu++;
+  }
+  vector<int> cpus(1, pinCpu);
+  string errStr;
+  if (ThreadTuning::pinToCpus(cpus, errStr)) {
+    cout << "SKIP " << test << ": " << errStr << endl;
+    return;
+  }
+
+  ServerSocket server;
+  if (server.openServer(port)) {
+    cout << "SKIP " << test << ": cannot open port " << port << endl;
+    ThreadTuning::clearTuning(errStr);
+    return;
+  }
+  CompressedTsReader reader("localhost", port, 0, 0);
+  reader.getNextPulse(true); // connects
+  Socket *client = server.getClient(1000);
+  check(client != NULL, test, "no connection");
+
+  // a small batch, then a large one
+
+  int nGot = 0;
+  if (client != NULL) {
+    IwrfTsInfo info;
+    int nGates = 64;
+    vector<fl32> iq(nGates * 2, 1.0);
+    vector<ui08> packet;
+    int batches[2] = { 2, 40 };
+    int seq = 0;
+    for (int ibatch = 0; ibatch < 2; ibatch++) {
+      for (int ii = 0; ii < batches[ibatch]; ii++) {
+        IwrfTsPulse pulse(info);
+        pulse.set_pulse_seq_num(seq++);
+        pulse.setIqFloats(nGates, 1, &iq[0]);
+        CompressedTs::encodePulse(pulse, 0, 0, 16, packet);
+        client->writeBuffer(&packet[0], packet.size(), 1000);
+      }
+      for (int ii = 0; ii < 100 && nGot < seq; ii++) {
+        IwrfTsPulse *pulse = reader.getNextPulse(true);
+        if (pulse != NULL) {
+          nGot++;
+          delete pulse;
+        }
+      }
+    }
+    check(nGot == seq, test, "pulses lost");
+    client->close();
+    delete client;
+  }
+
+  cpu_set_t cpusAfter;
+  pthread_getaffinity_np(pthread_self(), sizeof(cpusAfter), &cpusAfter);
+  check(CPU_COUNT(&cpusAfter) == 1 && CPU_ISSET(pinCpu, &cpusAfter),
+        test, "ingest thread pinning cleared by decode");
+
+  ThreadTuning::clearTuning(errStr);
+  pthread_getaffinity_np(pthread_self(), sizeof(cpusAfter), &cpusAfter);
+  check(CPU_EQUAL(&cpusAfter, &savedCpus), test, "cpus not restored");
+}
+
+// decoded pulses carry their radar id in the IWRF header, so
+// the sequence check keeps interleaved radars apart
+
+static void testDecodedRadarId()
+{
+  string test = "decodedRadarId";
+  int port = 17325;
+  ServerSocket server;
+  if (server.openServer(port)) {
+    cout << "SKIP " << test << ": cannot open port " << port << endl;
+    return;
+  }
+
+  CompressedTsReader reader("localhost", port, 0, 0);
+  reader.getNextPulse(true); // connects
+  Socket *client = server.getClient(1000);
+  check(client != NULL, test, "no connection");
+  if (client == NULL) {
+    return;
+  }
+
+  IwrfTsInfo info;
+  int nGates = 16;
+  vector<fl32> iq(nGates * 2, 1.0);
+  vector<ui08> packet;
+  int nSent = 10;
+  for (int ii = 0; ii < nSent; ii++) {
+    IwrfTsPulse pulse(info);
+    iwrf_pulse_header_t pulseHdr = pulse.getHdr();
+    pulseHdr.packet.radar_id = (ii % 2) ? 5 : 3;
+    pulse.setHeader(pulseHdr);
+    pulse.set_pulse_seq_num(ii);
+    pulse.setIqFloats(nGates, 1, &iq[0]);
+    CompressedTs::encodePulse(pulse, 0, 0, 16, packet);
+    client->writeBuffer(&packet[0], packet.size(), 1000);
+  }
+
+  int nGot = 0;
+  bool idsOk = true;
+  for (int ii = 0; ii < 100 && nGot < nSent; ii++) {
+    IwrfTsPulse *pulse = reader.getNextPulse(true);
+    if (pulse != NULL) {
+      int expected = (pulse->get_pulse_seq_num() % 2) ? 5 : 3;
+      if (pulse->getHdr().packet.radar_id != expected) {
+        idsOk = false;
+      }
+      nGot++;
+      delete pulse;
+    }
+  }
+  check(nGot == nSent, test, "pulses lost");
+  check(idsOk, test, "radar id not in pulse header");
+
+  client->close();
+  delete client;
+}
+
+// raw IWRF stream on localhost, with junk ahead of the first
+// packet - skipped and counted, not treated as a read failure
+
+static void testRawStream(AScope &scope)
+{
+  string test = "rawStream";
+  int port = 17322;
+  ServerSocket server;
+  if (server.openServer(port)) {
+    cout << "SKIP " << test << ": cannot open port " << port << endl;
+    return;
+  }
+
+  IwrfStreamReader *source = new IwrfStreamReader("localhost", port, 0, 0);
+  AScopeReader reader("", 0, "", true, scope, 0, -1, 0, source);
+  Collector coll(reader, true);
+  reader.pollData(); // connects
+  Socket *client = server.getClient(1000);
+  check(client != NULL, test, "no connection");
+  if (client == NULL) {
+    return;
+  }
+
+  vector<ui08> junk(57, 0x1c);
+  client->writeBuffer(&junk[0], junk.size(), 1000);
+
+  int blockSize = scope.getBlockSize();
+  sendRawBlock(client, blockSize, 0);
+
+  for (int ii = 0; ii < 100 && coll.nItems == 0; ii++) {
+    reader.pollData();
+  }
+  check(coll.chans.count(1) == 1, test, "no block received");
+  if (coll.chans.count(1) == 1) {
+    const Collector::chan_t &chan1 = coll.chans[1];
+    check((int) chan1.nBeams == blockSize, test, "wrong beam count");
+    check(chan1.first[5 * 2] == 1005, test, "chan 1 data");
+  }
+  check(reader.getNBytesSkipped() == 57, test, "bytes skipped");
+  check(reader.getNReconnects() == 0, test, "junk caused a reconnect");
+
+  client->close();
+  delete client;
+}
+
+// the server goes away and comes back on the same port - the
+// reader reconnects, with backoff, and blocks resume
+
+static void testReconnect(AScope &scope)
+{
+  string test = "reconnect";
+  int port = 17323;
+  ServerSocket *server = new ServerSocket;
+  if (server->openServer(port)) {
+    cout << "SKIP " << test << ": cannot open port " << port << endl;
+    delete server;
+    return;
+  }
+
+  IwrfStreamReader *source = new IwrfStreamReader("localhost", port, 0, 0);
+  AScopeReader reader("", 0, "", true, scope, 0, -1, 0, source);
+  Collector coll(reader, true);
+  reader.pollData(); // connects
+  Socket *client = server->getClient(1000);
+  check(client != NULL, test, "no connection");
+  if (client == NULL) {
+    delete server;
+    return;
+  }
+
+  int blockSize = scope.getBlockSize();
+  sendRawBlock(client, blockSize, 0);
+  for (int ii = 0; ii < 100 && coll.nItems == 0; ii++) {
+    reader.pollData();
+  }
+  check(coll.nItems == 1, test, "no block before server closed");
+
+  // server goes away - keep polling through a few failed
+  // attempts while it is down
+
+  client->close();
+  delete client;
+  delete server;
+  for (int ii = 0; ii < 20; ii++) {
+    reader.pollData();
+    umsleep(20);
+  }
+  int nReconnects = reader.getNReconnects();
+  check(nReconnects >= 1, test, "close not seen");
+  check(nReconnects < 20, test, "no backoff between attempts");
+
+  // server comes back - the reader connects once its backoff is up
+
+  server = new ServerSocket;
+  if (server->openServer(port)) {
+    cout << "SKIP " << test << ": cannot reopen port " << port << endl;
+    delete server;
+    return;
+  }
+  client = NULL;
+  for (int ii = 0; ii < 100 && client == NULL; ii++) {
+    reader.pollData();
+    client = server->getClient(50);
+  }
+  check(client != NULL, test, "no reconnection");
+  if (client == NULL) {
+    delete server;
+    return;
+  }
+
+  sendRawBlock(client, blockSize, blockSize);
+  for (int ii = 0; ii < 100 && coll.nItems == 1; ii++) {
+    reader.pollData();
+  }
+  check(coll.nItems == 2, test, "blocks did not resume");
+  if (coll.chans.count(0) == 1) {
+    check(coll.chans[0].first[1] == blockSize, test, "resumed block start");
+  }
+
+  client->close();
+  delete client;
+  delete server;
+}
+
+//////////////////////////////////////////////////////////////////////
+// benchmarks - time each assembly path and append one JSON object
+// per line to the output file
+
+static void bench(AScope &scope, ostream &out, const string &name,
+                  SyntheticTsReader::stream_t stream, bool simulMode,
+                  int burstChan, int decimateWidth,
+                  int nGates, int nBlocks)
+{
+
+  int blockSize = scope.getBlockSize();
+  int nChannels = (stream == SyntheticTsReader::STREAM_SINGLE_POL ? 1 : 2);
+  int pulsesPerBlock = blockSize;
+  if (stream == SyntheticTsReader::STREAM_ALTERNATING) {
+    pulsesPerBlock *= 2;
+  }
+  int nPulses = pulsesPerBlock * nBlocks;
+
+  SyntheticTsReader *source = new SyntheticTsReader;
+  source->addPulses(stream, nPulses, nGates);
+  source->setBurst(256);
+  AScopeReader reader("", 0, "", simulMode, scope, 0,
+                      burstChan, 0, source);
+  reader.setDecimateWidth(decimateWidth);
+  Collector coll(reader, false);
+
+  QElapsedTimer timer;
+  timer.start();
+  while (source->getNQueued() > 0) {
+    reader.pollData();
+  }
+  double secs = timer.nsecsElapsed() / 1.0e9;
+
+  double bytes = (double) nPulses * nGates * nChannels * 2 * sizeof(fl32);
+  double nsPerPulse = secs * 1.0e9 / nPulses;
+  double bytesPerSec = bytes / secs;
+
+  cout << name << ": " << nsPerPulse << " ns/pulse, "
+       << bytesPerSec / 1.0e6 << " MB/s" << endl;
+  out << "{\"bench\": \"" << name << "\""
+      << ", \"nGates\": " << nGates
+      << ", \"blockSize\": " << blockSize
+      << ", \"nPulses\": " << nPulses
+      << ", \"nItems\": " << coll.nItems
+      << ", \"nsPerPulse\": " << nsPerPulse
+      << ", \"bytesPerSec\": " << bytesPerSec
+      << "}" << endl;
+
+}
+
+// compressed transport - ratio, and encode and decode cost
+
+static void benchCodec(ostream &out, int nGates, int nBits, int nPulses)
+{
+
+  IwrfTsInfo info;
+  vector<IwrfTsPulse *> pulses;
+  vector<fl32> iq(nGates * 4);
+  unsigned int seed = 1;
+  for (int ii = 0; ii < nPulses; ii++) {
+    // noise, with a strong echo over a tenth of the range
+    for (int jj = 0; jj < nGates * 4; jj++) {
+      fl32 noise = (rand_r(&seed) / (fl32) RAND_MAX) - 0.5;
+      int igate = (jj / 2) % nGates;
+      iq[jj] = (igate > nGates / 2 && igate < nGates * 6 / 10) ?
+        noise * 1000 : noise;
+    }
+    IwrfTsPulse *pulse = new IwrfTsPulse(info);
+    pulse->setIqFloats(nGates, 2, &iq[0]);
+    pulses.push_back(pulse);
+  }
+
+  vector< vector<ui08> > packets(nPulses);
+  QElapsedTimer timer;
+  timer.start();
+  for (int ii = 0; ii < nPulses; ii++) {
+    CompressedTs::encodePulse(*pulses[ii], 0, 0, nBits, packets[ii]);
+  }
+  double encodeSecs = timer.nsecsElapsed() / 1.0e9;
+
+  CompressedTs::decoded_t decoded;
+  double packetBytes = 0.0;
+  timer.restart();
+  for (int ii = 0; ii < nPulses; ii++) {
+    CompressedTs::decode(&packets[ii][0], packets[ii].size(), decoded);
+    packetBytes += packets[ii].size();
+  }
+  double decodeSecs = timer.nsecsElapsed() / 1.0e9;
+
+  double rawBytes = (double) nPulses * nGates * 2 * 2 * sizeof(fl32);
+  double ratio = rawBytes / packetBytes;
+  string name = "codec" + to_string(nBits) + "bit";
+  cout << name << ": ratio " << ratio
+       << ", encode " << encodeSecs * 1.0e9 / nPulses << " ns/pulse"
+       << ", decode " << decodeSecs * 1.0e9 / nPulses << " ns/pulse"
+       << endl;
+  out << "{\"bench\": \"" << name << "\""
+      << ", \"nGates\": " << nGates
+      << ", \"nPulses\": " << nPulses
+      << ", \"ratio\": " << ratio
+      << ", \"encodeNsPerPulse\": " << encodeSecs * 1.0e9 / nPulses
+      << ", \"decodeNsPerPulse\": " << decodeSecs * 1.0e9 / nPulses
+      << "}" << endl;
+
+  for (int ii = 0; ii < nPulses; ii++) {
+    delete pulses[ii];
+  }
+
+}
+
+//////////////////////////////////////////////////////////////////////
+
+int main(int argc, char **argv)
+{
+
+  bool doBench = false;
+  int nGates = 2000;
+  int nBlocks = 4;
+  string benchOut = "bench_output.txt";
+
+  po::options_description descripts("Options");
+  descripts.add_options()
+    ("help", "describe options")
+    ("bench", "run the benchmarks as well as the tests")
+    ("gates", po::value<int>(&nGates), "Gates per pulse for benchmarks")
+    ("blocks", po::value<int>(&nBlocks), "Blocks per benchmark")
+    ("benchOut", po::value<string>(&benchOut),
+     "Benchmark results file, one JSON object per line")
+    ;
+  po::variables_map vm;
+  try {
+    po::store(po::parse_command_line(argc, argv, descripts), vm);
+  }
+  catch(exception & ex) {
+    cerr << "ERROR parsing command line: " << ex.what() << endl;
+    cerr << descripts << endl;
+    exit(1);
+  }
+  po::notify(vm);
+  if (vm.count("help")) {
+    cout << descripts << endl;
+    exit(1);
+  }
+  if (vm.count("bench")) {
+    doBench = true;
+  }
+
+  QApplication app(argc, argv);
+  AScope scope(50.0, ".");
+
+  testSinglePol(scope);
+  testSimultaneous(scope);
+  testAlternating(scope, -1);
+  for (int burstChan = 0; burstChan < 4; burstChan++) {
+    testAlternating(scope, burstChan);
+  }
+  testUnevenGates(scope);
+  testNullIq(scope);
+  testSequenceSplit(scope);
+  testLatePulseDiscard(scope);
+  testSequenceReset(scope);
+  testDecimation(scope);
+  testDecimationMovingPeak(scope);
+  testHistory(scope);
+  testCodec();
+  testCompressedStream(scope);
+  testDecodeKeepsTuning();
+  testDecodedRadarId();
+  testRawStream(scope);
+  testReconnect(scope);
+
+  cout << "Tests: " << _nPassed << " checks passed, "
+       << _nFailed << " failed" << endl;
+
+  if (doBench) {
+    ofstream out(benchOut.c_str());
+    if (!out) {
+      cerr << "ERROR - cannot open " << benchOut << endl;
+      return 1;
+    }
+    bench(scope, out, "singlePol", SyntheticTsReader::STREAM_SINGLE_POL,
+          false, -1, 0, nGates, nBlocks);
+    bench(scope, out, "simultaneous", SyntheticTsReader::STREAM_SIMULTANEOUS,
+          true, -1, 0, nGates, nBlocks);
+    bench(scope, out, "alternating", SyntheticTsReader::STREAM_ALTERNATING,
+          false, -1, 0, nGates, nBlocks);
+    bench(scope, out, "alternatingBurst",
+          SyntheticTsReader::STREAM_ALTERNATING,
+          false, 2, 0, nGates, nBlocks);
+    bench(scope, out, "alternatingDecimated",
+          SyntheticTsReader::STREAM_ALTERNATING,
+          false, -1, 1500, nGates * 4, max(1, nBlocks / 4));
+    benchCodec(out, nGates, 16, 1000);
+    benchCodec(out, nGates, 10, 1000);
+  }
+
+  return (_nFailed == 0 ? 0 : 1);
+
+}
@@ -0,0 +1,361 @@
+// *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* 
+// ** Copyright UCAR (c) 1990 - 2016                                         
+// ** University Corporation for Atmospheric Research (UCAR)                 
+// ** National Center for Atmospheric Research (NCAR)                        
+// ** Boulder, Colorado, USA                                                 
+// ** BSD licence applies - redistribution and use in source and binary      
+// ** forms, with or without modification, are permitted provided that       
+// ** the following conditions are met:                                      
+// ** 1) If the software is modified to produce derivative works,            
+// ** such modified software should be clearly marked, so as not             
+// ** to confuse it with the version available from UCAR.                    
+// ** 2) Redistributions of source code must retain the above copyright      
+// ** notice, this list of conditions and the following disclaimer.          
+// ** 3) Redistributions in binary form must reproduce the above copyright   
+// ** notice, this list of conditions and the following disclaimer in the    
+// ** documentation and/or other materials provided with the distribution.   
+// ** 4) Neither the name of UCAR nor the names of its contributors,         
+// ** if any, may be used to endorse or promote products derived from        
+// ** this software without specific prior written permission.               
+// ** DISCLAIMER: THIS SOFTWARE IS PROVIDED "AS IS" AND WITHOUT ANY EXPRESS  
+// ** OR IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED      
+// ** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.    
+// *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* 
+#include "CompressedTs.h"
+#include <cstring>
+#include <cstddef>
+#include <cmath>
+#include <lz4.h>
+using namespace std;
+
+///////////////////////////////////////////////
+// encode a pulse
+
+int CompressedTs::encodePulse(const IwrfTsPulse &pulse,
+                              int startGate, int maxGates, int nBits,
+                              vector<ui08> &packet)
+
+{
+
+  int nGatesPulse = pulse.getNGates();
+  if (startGate < 0) {
+    startGate = 0;
+  }
+  if (startGate > nGatesPulse) {
+    startGate = nGatesPulse;
+  }
+  int nGates = nGatesPulse - startGate;
+  if (maxGates > 0 && nGates > maxGates) {
+    nGates = maxGates;
+  }
+  if (startGate + nGates > MAX_GATES) {
+    return -1;
+  }
+
+  const fl32 *iq[MAX_CHANNELS];
+  int nChannels = 0;
+  if (pulse.getIq0() != NULL) {
+    iq[nChannels++] = pulse.getIq0() + startGate * 2;
+    if (pulse.getIq1() != NULL) {
+      iq[nChannels++] = pulse.getIq1() + startGate * 2;
+    }
+  }
+
+  compressed_ts_hdr_t hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.id = PULSE_ID;
+  hdr.seq_num = pulse.get_pulse_seq_num();
+  hdr.time_secs = pulse.getTime();
+  hdr.nano_secs = pulse.getNanoSecs();
+  hdr.hv_flag = pulse.get_hv_flag();
+  hdr.prt = pulse.get_prt();
+  hdr.radar_id = pulse.getHdr().packet.radar_id;
+  hdr.start_gate = startGate;
+  hdr.n_gates = (nChannels > 0 ? nGates : 0);
+  hdr.n_channels = nChannels;
+
+  return _encode(hdr, iq, nBits, packet);
+
+}
+
+///////////////////////////////////////////////
+// encode a burst
+
+int CompressedTs::encodeBurst(const IwrfTsBurst &burst,
+                              vector<ui08> &packet)
+
+{
+
+  IwrfTsBurst copy(burst);
+  copy.convertToFL32();
+  if (copy.getIq() == NULL) {
+    return -1;
+  }
+
+  const fl32 *iq[MAX_CHANNELS];
+  iq[0] = copy.getIq();
+
+  compressed_ts_hdr_t hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.id = BURST_ID;
+  hdr.seq_num = copy.getPulseSeqNum();
+  hdr.n_gates = copy.getNSamples();
+  if (hdr.n_gates > MAX_GATES) {
+    return -1;
+  }
+  hdr.n_channels = 1;
+  hdr.sampling_freq_hz = copy.getSamplingFreqHz();
+
+  return _encode(hdr, iq, 16, packet);
+
+}
+
+///////////////////////////////////////////////
+// requantize, shuffle and compress IQ behind the header
+
+int CompressedTs::_encode(compressed_ts_hdr_t &hdr,
+                          const fl32 * const *iq, int nBits,
+                          vector<ui08> &packet)
+
+{
+
+  if (nBits < 2) {
+    nBits = 2;
+  }
+  if (nBits > 16) {
+    nBits = 16;
+  }
+  fl32 maxCount = (fl32) ((1 << (nBits - 1)) - 1);
+
+  int nVals = hdr.n_gates * 2;
+  int nShorts = nVals * hdr.n_channels;
+
+  // requantize to nBits, scaled per channel from the peak
+  // magnitude, and store as int16 byte-shuffled so that LZ4
+  // finds the redundancy in the high bytes
+
+  vector<ui08> raw(nShorts * 2 + 1);
+  ui08 *lo = &raw[0];
+  ui08 *hi = lo + nShorts;
+
+  for (int ichan = 0; ichan < hdr.n_channels; ichan++) {
+    const fl32 *vals = iq[ichan];
+    fl32 maxAbs = 0.0;
+    for (int ii = 0; ii < nVals; ii++) {
+      fl32 absVal = fabsf(vals[ii]);
+      if (absVal > maxAbs) {
+        maxAbs = absVal;
+      }
+    }
+    fl32 scale = (maxAbs > 0 ? maxAbs / maxCount : 1.0f);
+    fl32 invScale = 1.0f / scale;
+    hdr.scale[ichan] = scale;
+    int offset = ichan * nVals;
+    for (int ii = 0; ii < nVals; ii++) {
+      si16 val = (si16) lrintf(vals[ii] * invScale);
+      lo[offset + ii] = (ui08) (val & 0xff);
+      hi[offset + ii] = (ui08) ((val >> 8) & 0xff);
+    }
+  }
+  hdr.raw_bytes = nShorts * 2;
+
+  // compress
+
+  size_t hdrLen = sizeof(compressed_ts_hdr_t);
+  int bound = LZ4_compressBound(hdr.raw_bytes);
+  packet.resize(hdrLen + bound);
+  int compressedLen = LZ4_compress_default((const char *) lo,
+                                           (char *) &packet[hdrLen],
+                                           hdr.raw_bytes, bound);
+  if (compressedLen <= 0) {
+    packet.clear();
+    return -1;
+  }
+  packet.resize(hdrLen + compressedLen);
+
+  hdr.len_bytes = packet.size();
+  hdr.check = _headerCheck(hdr);
+  memcpy(&packet[0], &hdr, hdrLen);
+
+  return 0;
+
+}
+
+///////////////////////////////////////////////
+// header check word - CRC-32 of the header before the check
+
+ui32 CompressedTs::_headerCheck(const compressed_ts_hdr_t &hdr)
+
+{
+  return _crc32((const ui08 *) &hdr, offsetof(compressed_ts_hdr_t, check));
+}
+
+///////////////////////////////////////////////
+// CRC-32, as used by zlib and ethernet
+
+ui32 CompressedTs::_crc32(const ui08 *buf, size_t len)
+
+{
+
+  // table built on first use - thread safe as a local static
+
+  struct table_t {
+    ui32 vals[256];
+    table_t() {
+      for (ui32 ii = 0; ii < 256; ii++) {
+        ui32 crc = ii;
+        for (int jj = 0; jj < 8; jj++) {
+          crc = (crc & 1) ? (0xedb88320 ^ (crc >> 1)) : (crc >> 1);
+        }
+        vals[ii] = crc;
+      }
+    }
+  };
+  static const table_t table;
+
+  ui32 crc = 0xffffffff;
+  for (size_t ii = 0; ii < len; ii++) {
+    crc = table.vals[(crc ^ buf[ii]) & 0xff] ^ (crc >> 8);
+  }
+  return crc ^ 0xffffffff;
+
+}
+
+///////////////////////////////////////////////
+// check a candidate header
+
+int CompressedTs::checkHeader(const ui08 *buf)
+
+{
+
+  compressed_ts_hdr_t hdr;
+  memcpy(&hdr, buf, sizeof(hdr));
+
+  if (hdr.id != PULSE_ID && hdr.id != BURST_ID) {
+    return -1;
+  }
+  if (hdr.check != _headerCheck(hdr)) {
+    return -1;
+  }
+  if (hdr.len_bytes < sizeof(hdr) || hdr.len_bytes > MAX_PACKET_BYTES) {
+    return -1;
+  }
+  if (hdr.n_channels < 0 || hdr.n_channels > MAX_CHANNELS ||
+      hdr.n_gates < 0 || hdr.start_gate < 0 ||
+      (si64) hdr.start_gate + hdr.n_gates > MAX_GATES) {
+    return -1;
+  }
+
+  // in 64 bits - the bounds above keep this well inside ui32,
+  // but the check must not depend on that
+
+  ui64 rawBytes = (ui64) hdr.n_gates * hdr.n_channels * 2 * sizeof(si16);
+  if (hdr.raw_bytes != rawBytes) {
+    return -1;
+  }
+
+  // LZ4 cannot expand the payload by more than LZ4_MAX_RATIO
+
+  ui64 payloadBytes = hdr.len_bytes - sizeof(hdr);
+  if (rawBytes > payloadBytes * LZ4_MAX_RATIO + 16) {
+    return -1;
+  }
+
+  return 0;
+
+}
+
+///////////////////////////////////////////////
+// find the next possible packet id
+
+size_t CompressedTs::findPacketId(const ui08 *buf, size_t len)
+
+{
+
+  // both ids share their second byte in memory, so search
+  // for that and then compare the whole id
+
+  ui32 pulseId = PULSE_ID;
+  ui08 idBytes[4];
+  memcpy(idBytes, &pulseId, 4);
+
+  size_t pos = 1;
+  while (pos < len) {
+    const ui08 *hit = (const ui08 *) memchr(buf + pos, idBytes[1], len - pos);
+    if (hit == NULL) {
+      break;
+    }
+    size_t start = (hit - buf) - 1;
+    if (start + 4 > len) {
+      // may be an id cut off by the end of the buffer
+      return start;
+    }
+    ui32 id;
+    memcpy(&id, buf + start, 4);
+    if (id == PULSE_ID || id == BURST_ID) {
+      return start;
+    }
+    pos = (hit - buf) + 1;
+  }
+
+  // a single byte left may start either id
+
+  ui32 burstId = BURST_ID;
+  ui08 burstBytes[4];
+  memcpy(burstBytes, &burstId, 4);
+  if (len > 0 &&
+      (buf[len - 1] == idBytes[0] || buf[len - 1] == burstBytes[0])) {
+    return len - 1;
+  }
+  return len;
+
+}
+
+///////////////////////////////////////////////
+// decode a packet
+
+int CompressedTs::decode(const ui08 *packet, size_t len, decoded_t &decoded)
+
+{
+
+  size_t hdrLen = sizeof(compressed_ts_hdr_t);
+  if (len < hdrLen || checkHeader(packet)) {
+    return -1;
+  }
+  compressed_ts_hdr_t &hdr = decoded.hdr;
+  memcpy(&hdr, packet, hdrLen);
+  if (hdr.len_bytes != len) {
+    return -1;
+  }
+
+  vector<ui08> raw(hdr.raw_bytes + 1);
+  int rawLen = LZ4_decompress_safe((const char *) packet + hdrLen,
+                                   (char *) &raw[0],
+                                   len - hdrLen, hdr.raw_bytes);
+  if (rawLen != (int) hdr.raw_bytes) {
+    return -1;
+  }
+
+  // unshuffle into place after start_gate, leaving zeros before it
+
+  size_t nVals = (size_t) hdr.n_gates * 2;
+  size_t nShorts = nVals * hdr.n_channels;
+  size_t nValsOut = (size_t) (hdr.start_gate + hdr.n_gates) * 2;
+  size_t startVal = (size_t) hdr.start_gate * 2;
+  const ui08 *lo = &raw[0];
+  const ui08 *hi = lo + nShorts;
+  decoded.iq.assign(nValsOut * hdr.n_channels, 0.0f);
+
+  for (int ichan = 0; ichan < hdr.n_channels; ichan++) {
+    fl32 scale = hdr.scale[ichan];
+    size_t offset = ichan * nVals;
+    fl32 *iq = decoded.iq.data() + ichan * nValsOut + startVal;
+    for (size_t ii = 0; ii < nVals; ii++) {
+      si16 val = (si16) (lo[offset + ii] | (hi[offset + ii] << 8));
+      iq[ii] = val * scale;
+    }
+  }
+
+  return 0;
+
+}
@@ -0,0 +1,129 @@
+/* *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* */
+/* ** Copyright UCAR (c) 1990 - 2016                                         */
+/* ** University Corporation for Atmospheric Research (UCAR)                 */
+/* ** National Center for Atmospheric Research (NCAR)                        */
+/* ** Boulder, Colorado, USA                                                 */
+/* ** BSD licence applies - redistribution and use in source and binary      */
+/* ** forms, with or without modification, are permitted provided that       */
+/* ** the following conditions are met:                                      */
+/* ** 1) If the software is modified to produce derivative works,            */
+/* ** such modified software should be clearly marked, so as not             */
+/* ** to confuse it with the version available from UCAR.                    */
+/* ** 2) Redistributions of source code must retain the above copyright      */
+/* ** notice, this list of conditions and the following disclaimer.          */
+/* ** 3) Redistributions in binary form must reproduce the above copyright   */
+/* ** notice, this list of conditions and the following disclaimer in the    */
+/* ** documentation and/or other materials provided with the distribution.   */
+/* ** 4) Neither the name of UCAR nor the names of its contributors,         */
+/* ** if any, may be used to endorse or promote products derived from        */
+/* ** this software without specific prior written permission.               */
+/* ** DISCLAIMER: THIS SOFTWARE IS PROVIDED "AS IS" AND WITHOUT ANY EXPRESS  */
+/* ** OR IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED      */
+/* ** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.    */
+/* *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* */
+#ifndef COMPRESSEDTS_H_
+#define COMPRESSEDTS_H_
+
+#include <vector>
+#include <cstddef>
+#include <dataport/port_types.h>
+#include <radar/IwrfTsPulse.hh>
+#include <radar/IwrfTsBurst.hh>
+
+/// Compressed time series transport, used between tsrelay and
+/// tcpscope --compressed.
+///
+/// Each packet is a compressed_ts_hdr_t followed by the payload.
+/// IQ is windowed in range, requantized to int16 with a per-channel
+/// scale, byte-shuffled (all low bytes, then all high bytes) and
+/// LZ4 compressed. Byte order is that of the host, as for IWRF.
+/// The header carries a CRC-32, and its sizes are bounded, so that
+/// a damaged header is rejected before anything is allocated.
+///
+/// Encoding and decoding do not touch shared state, so decodes
+/// may run in parallel.
+
+class CompressedTs
+{
+
+public:
+
+  static const ui32 PULSE_ID = 0x77771c01;
+  static const ui32 BURST_ID = 0x77771c02;
+  static const ui32 MAX_PACKET_BYTES = 64 * 1024 * 1024;
+  static const int MAX_CHANNELS = 2;
+  static const int MAX_GATES = 1024 * 1024; // start_gate + n_gates
+  static const int LZ4_MAX_RATIO = 255; // worst case LZ4 expansion
+
+  typedef struct {
+    ui32 id;              // PULSE_ID or BURST_ID
+    ui32 len_bytes;       // packet length, including this header
+    si64 seq_num;         // pulse sequence number
+    si64 time_secs;       // pulse time
+    si32 nano_secs;
+    si32 hv_flag;
+    fl32 prt;
+    si32 radar_id;        // from the IWRF packet info
+    si32 start_gate;      // first gate sent, from the window
+    si32 n_gates;         // gates sent, or burst samples
+    si32 n_channels;
+    ui32 raw_bytes;       // payload length before compression
+    fl32 scale[MAX_CHANNELS]; // int16 to float, per channel
+    fl64 sampling_freq_hz; // burst only
+    si32 spare;
+    ui32 check;           // CRC-32 of the header up to here
+  } compressed_ts_hdr_t;
+
+  /// A decoded packet - header and float IQ, channels in sequence.
+  /// Each channel holds start_gate + n_gates gates, zero before
+  /// start_gate, so that gate numbers match the source.
+  typedef struct {
+    compressed_ts_hdr_t hdr;
+    std::vector<fl32> iq;
+  } decoded_t;
+
+  /// Encode a pulse, which must hold float IQ
+  /// @param startGate First gate to send
+  /// @param maxGates Maximum gates to send, 0 for all
+  /// @param nBits Bits kept per value, 2 to 16. Fewer bits leave
+  /// the high bytes mostly constant, which compresses further, at
+  /// the cost of dynamic range: the scale is set by the peak in
+  /// each channel, and values more than about 6 * (nBits - 1) dB
+  /// below it quantize to zero - 54 dB at 10 bits, 90 dB at 16.
+  /// @return 0 on success, -1 on failure
+  static int encodePulse(const IwrfTsPulse &pulse,
+                         int startGate, int maxGates, int nBits,
+                         std::vector<ui08> &packet);
+
+  /// Encode a burst
+  /// @return 0 on success, -1 on failure
+  static int encodeBurst(const IwrfTsBurst &burst,
+                         std::vector<ui08> &packet);
+
+  /// Check a header
+  /// @param buf Start of the candidate header, at least
+  /// sizeof(compressed_ts_hdr_t) bytes
+  /// @return 0 if valid, -1 if not
+  static int checkHeader(const ui08 *buf);
+
+  /// Find the next possible packet start in a damaged stream.
+  /// Looks for a packet id using memchr, which is vectorized
+  /// in the C library.
+  /// @return offset of the candidate, or len if none
+  static size_t findPacketId(const ui08 *buf, size_t len);
+
+  /// Decode a complete packet
+  /// @return 0 on success, -1 on failure
+  static int decode(const ui08 *packet, size_t len, decoded_t &decoded);
+
+private:
+
+  static ui32 _headerCheck(const compressed_ts_hdr_t &hdr);
+  static ui32 _crc32(const ui08 *buf, size_t len);
+  static int _encode(compressed_ts_hdr_t &hdr,
+                     const fl32 * const *iq, int nBits,
+                     std::vector<ui08> &packet);
+
+};
+
+#endif /*COMPRESSEDTS_H_*/
@@ -0,0 +1,186 @@
+// *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* 
+// ** Copyright UCAR (c) 1990 - 2016                                         
+// ** University Corporation for Atmospheric Research (UCAR)                 
+// ** National Center for Atmospheric Research (NCAR)                        
+// ** Boulder, Colorado, USA                                                 
+// ** BSD licence applies - redistribution and use in source and binary      
+// ** forms, with or without modification, are permitted provided that       
+// ** the following conditions are met:                                      
+// ** 1) If the software is modified to produce derivative works,            
+// ** such modified software should be clearly marked, so as not             
+// ** to confuse it with the version available from UCAR.                    
+// ** 2) Redistributions of source code must retain the above copyright      
+// ** notice, this list of conditions and the following disclaimer.          
+// ** 3) Redistributions in binary form must reproduce the above copyright   
+// ** notice, this list of conditions and the following disclaimer in the    
+// ** documentation and/or other materials provided with the distribution.   
+// ** 4) Neither the name of UCAR nor the names of its contributors,         
+// ** if any, may be used to endorse or promote products derived from        
+// ** this software without specific prior written permission.               
+// ** DISCLAIMER: THIS SOFTWARE IS PROVIDED "AS IS" AND WITHOUT ANY EXPRESS  
+// ** OR IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED      
+// ** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.    
+// *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* 
+#include "CompressedTsReader.h"
+#include "ThreadTuning.h"
+#include <QElapsedTimer>
+#include <QtConcurrent>
+#include <cstring>
+#include <iostream>
+using namespace std;
+
+CompressedTsReader::CompressedTsReader(const string &host,
+                                       int port,
+                                       int radarId,
+                                       int debugLevel):
+        StreamTsReader(host, port, radarId, debugLevel),
+        _nPacketsDecoded(0),
+        _decodeSecs(0.0)
+{
+}
+
+CompressedTsReader::~CompressedTsReader()
+
+{
+}
+
+///////////////////////////////////////////////
+// mean decode time
+
+double CompressedTsReader::getDecodeUsecsPerPacket() const
+
+{
+  if (_nPacketsDecoded == 0) {
+    return 0.0;
+  }
+  return (_decodeSecs * 1.0e6) / _nPacketsDecoded;
+}
+
+///////////////////////////////////////////////
+// check the header at the start of buf
+
+StreamTsReader::packetStatus_t
+  CompressedTsReader::_checkPacket(const ui08 *buf, size_t len,
+                                   size_t &packetLen)
+
+{
+
+  if (len < sizeof(CompressedTs::compressed_ts_hdr_t)) {
+    return PACKET_SHORT;
+  }
+  if (CompressedTs::checkHeader(buf)) {
+    return PACKET_BAD;
+  }
+  CompressedTs::compressed_ts_hdr_t hdr;
+  memcpy(&hdr, buf, sizeof(hdr));
+  packetLen = hdr.len_bytes;
+  return PACKET_OK;
+
+}
+
+///////////////////////////////////////////////
+// find the next possible packet start
+
+size_t CompressedTsReader::_findPacketStart(const ui08 *buf, size_t len)
+
+{
+  return CompressedTs::findPacketId(buf, len);
+}
+
+///////////////////////////////////////////////
+// decode the packets, and queue the pulses
+
+void CompressedTsReader::_decodePackets(const vector<const ui08 *> &packets,
+                                        const vector<size_t> &lens)
+
+{
+
+  size_t nPackets = packets.size();
+  if (_jobs.size() < nPackets) {
+    _jobs.resize(nPackets);
+  }
+  for (size_t ii = 0; ii < nPackets; ii++) {
+    _jobs[ii].packet = packets[ii];
+    _jobs[ii].len = lens[ii];
+  }
+
+  // decode - in parallel if there are enough to be worth it
+
+  QElapsedTimer timer;
+  timer.start();
+  if (nPackets >= MIN_PARALLEL_BATCH) {
+    QtConcurrent::blockingMap(_jobs.begin(), _jobs.begin() + nPackets,
+                              _decodeJob);
+  } else {
+    for (size_t ii = 0; ii < nPackets; ii++) {
+      _decodeJob(_jobs[ii]);
+    }
+  }
+  _decodeSecs += timer.nsecsElapsed() / 1.0e9;
+  _nPacketsDecoded += nPackets;
+
+  // load pulses and burst, in stream order
+
+  for (size_t ii = 0; ii < nPackets; ii++) {
+
+    const job_t &job = _jobs[ii];
+    if (job.status != 0) {
+      _nDecodeErrors++;
+      continue;
+    }
+    const CompressedTs::compressed_ts_hdr_t &hdr = job.decoded.hdr;
+    if (_filterRadarId != 0 && hdr.radar_id != _filterRadarId) {
+      continue;
+    }
+
+    // decoded IQ is padded to start at gate 0
+    int nGates = hdr.start_gate + hdr.n_gates;
+
+    if (hdr.id == CompressedTs::BURST_ID) {
+      _burst.setSamplingFreqHz(hdr.sampling_freq_hz);
+      _burst.setIqFloats(nGates, job.decoded.iq.data());
+      continue;
+    }
+
+    IwrfTsPulse *pulse = new IwrfTsPulse(_info);
+    // radar id first - setHeader overwrites the whole header
+    iwrf_pulse_header_t pulseHdr = pulse->getHdr();
+    pulseHdr.packet.radar_id = hdr.radar_id;
+    pulse->setHeader(pulseHdr);
+    pulse->setTime(hdr.time_secs, hdr.nano_secs);
+    pulse->set_pulse_seq_num(hdr.seq_num);
+    pulse->set_prt(hdr.prt);
+    pulse->set_hv_flag(hdr.hv_flag);
+    if (hdr.n_channels > 0) {
+      pulse->setIqFloats(nGates, hdr.n_channels, job.decoded.iq.data());
+    }
+    _queuePulse(pulse);
+
+  } // ii
+
+}
+
+///////////////////////////////////////////////
+// decode one packet - runs on the thread pool
+
+void CompressedTsReader::_decodeJob(job_t &job)
+
+{
+
+  // pool threads are started lazily, from the ingest thread, and
+  // inherit its cpu pinning and priority - clear them, once per
+  // thread. Some jobs run on the ingest thread itself, which
+  // keeps its tuning.
+
+  static thread_local bool checked = false;
+  if (!checked) {
+    if (!ThreadTuning::isTuned()) {
+      string errStr;
+      ThreadTuning::clearTuning(errStr);
+    }
+    checked = true;
+  }
+
+  job.status = CompressedTs::decode(job.packet, job.len, job.decoded);
+
+}
@@ -0,0 +1,88 @@
+/* *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* */
+/* ** Copyright UCAR (c) 1990 - 2016                                         */
+/* ** University Corporation for Atmospheric Research (UCAR)                 */
+/* ** National Center for Atmospheric Research (NCAR)                        */
+/* ** Boulder, Colorado, USA                                                 */
+/* ** BSD licence applies - redistribution and use in source and binary      */
+/* ** forms, with or without modification, are permitted provided that       */
+/* ** the following conditions are met:                                      */
+/* ** 1) If the software is modified to produce derivative works,            */
+/* ** such modified software should be clearly marked, so as not             */
+/* ** to confuse it with the version available from UCAR.                    */
+/* ** 2) Redistributions of source code must retain the above copyright      */
+/* ** notice, this list of conditions and the following disclaimer.          */
+/* ** 3) Redistributions in binary form must reproduce the above copyright   */
+/* ** notice, this list of conditions and the following disclaimer in the    */
+/* ** documentation and/or other materials provided with the distribution.   */
+/* ** 4) Neither the name of UCAR nor the names of its contributors,         */
+/* ** if any, may be used to endorse or promote products derived from        */
+/* ** this software without specific prior written permission.               */
+/* ** DISCLAIMER: THIS SOFTWARE IS PROVIDED "AS IS" AND WITHOUT ANY EXPRESS  */
+/* ** OR IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED      */
+/* ** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.    */
+/* *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* */
+#ifndef COMPRESSEDTSREADER_H_
+#define COMPRESSEDTSREADER_H_
+
+#include <string>
+#include <vector>
+
+#include "StreamTsReader.h"
+#include "CompressedTs.h"
+
+/// Reads the compressed time series stream from tsrelay, and
+/// hands out pulses as an IwrfTsReader.
+///
+/// Reading is non-blocking, see StreamTsReader. The packets that
+/// arrive together are decoded together, in parallel with
+/// QtConcurrent when there are enough of them. If a header fails
+/// its check, the stream is scanned forward for the next packet id
+/// without dropping the connection.
+
+class CompressedTsReader : public StreamTsReader
+{
+
+public:
+
+  /// Constructor
+  /// @param host The relay host
+  /// @param port The relay port
+  /// @param radarId Keep only pulses from this radar, 0 for all
+  CompressedTsReader(const std::string &host, int port,
+                     int radarId, int debugLevel);
+
+  /// Destructor
+  virtual ~CompressedTsReader();
+
+  /// @return mean decode time per packet, microseconds
+  double getDecodeUsecsPerPacket() const;
+
+protected:
+
+  virtual packetStatus_t _checkPacket(const ui08 *buf, size_t len,
+                                      size_t &packetLen);
+  virtual size_t _findPacketStart(const ui08 *buf, size_t len);
+  virtual void _decodePackets(const std::vector<const ui08 *> &packets,
+                              const std::vector<size_t> &lens);
+
+private:
+
+  static const int MIN_PARALLEL_BATCH = 8;
+
+  typedef struct {
+    const ui08 *packet;
+    size_t len;
+    CompressedTs::decoded_t decoded;
+    int status;
+  } job_t;
+
+  std::vector<job_t> _jobs;
+
+  si64 _nPacketsDecoded;
+  double _decodeSecs;
+
+  static void _decodeJob(job_t &job);
+
+};
+
+#endif /*COMPRESSEDTSREADER_H_*/
@@ -0,0 +1,243 @@
+// *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* 
+// ** Copyright UCAR (c) 1990 - 2016                                         
+// ** University Corporation for Atmospheric Research (UCAR)                 
+// ** National Center for Atmospheric Research (NCAR)                        
+// ** Boulder, Colorado, USA                                                 
+// ** BSD licence applies - redistribution and use in source and binary      
+// ** forms, with or without modification, are permitted provided that       
+// ** the following conditions are met:                                      
+// ** 1) If the software is modified to produce derivative works,            
+// ** such modified software should be clearly marked, so as not             
+// ** to confuse it with the version available from UCAR.                    
+// ** 2) Redistributions of source code must retain the above copyright      
+// ** notice, this list of conditions and the following disclaimer.          
+// ** 3) Redistributions in binary form must reproduce the above copyright   
+// ** notice, this list of conditions and the following disclaimer in the    
+// ** documentation and/or other materials provided with the distribution.   
+// ** 4) Neither the name of UCAR nor the names of its contributors,         
+// ** if any, may be used to endorse or promote products derived from        
+// ** this software without specific prior written permission.               
+// ** DISCLAIMER: THIS SOFTWARE IS PROVIDED "AS IS" AND WITHOUT ANY EXPRESS  
+// ** OR IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED      
+// ** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.    
+// *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* 
+#include "IwrfStreamReader.h"
+#include <cstring>
+#include <iostream>
+#include <radar/iwrf_data.h>
+using namespace std;
+
+IwrfStreamReader::IwrfStreamReader(const string &host,
+                                   int port,
+                                   int radarId,
+                                   int debugLevel):
+        StreamTsReader(host, port, radarId, debugLevel)
+{
+}
+
+IwrfStreamReader::~IwrfStreamReader()
+
+{
+}
+
+///////////////////////////////////////////////
+// the packet ids we accept - all 0x7777xxxx
+
+const si32 IwrfStreamReader::_packetIds[] = {
+  IWRF_SYNC_ID,
+  IWRF_RADAR_INFO_ID,
+  IWRF_SCAN_SEGMENT_ID,
+  IWRF_ANTENNA_CORRECTION_ID,
+  IWRF_TS_PROCESSING_ID,
+  IWRF_XMIT_POWER_ID,
+  IWRF_XMIT_SAMPLE_ID,
+  IWRF_CALIBRATION_ID,
+  IWRF_EVENT_NOTICE_ID,
+  IWRF_PHASECODE_ID,
+  IWRF_XMIT_INFO_ID,
+  IWRF_PULSE_HEADER_ID,
+  IWRF_BURST_HEADER_ID,
+  IWRF_RVP8_PULSE_HEADER_ID,
+  IWRF_RVP8_OPS_INFO_ID,
+  IWRF_STATUS_XML_ID,
+  IWRF_ANTENNA_ANGLES_ID,
+  IWRF_PLATFORM_GEOREF_ID,
+  IWRF_GEOREF_CORRECTION_ID
+};
+
+const int IwrfStreamReader::_nPacketIds =
+  sizeof(_packetIds) / sizeof(_packetIds[0]);
+
+bool IwrfStreamReader::_isPacketId(si32 id)
+
+{
+  for (int ii = 0; ii < _nPacketIds; ii++) {
+    if (id == _packetIds[ii]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+///////////////////////////////////////////////
+// could the len (< 4) bytes at buf be the start of a packet id,
+// cut off by the end of the buffer
+
+bool IwrfStreamReader::_isPacketIdPrefix(const ui08 *buf, size_t len)
+
+{
+  for (int ii = 0; ii < _nPacketIds; ii++) {
+    if (memcmp(buf, &_packetIds[ii], len) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+///////////////////////////////////////////////
+// IQ data follows the header as 2 or 4 byte values,
+// depending on the encoding
+
+bool IwrfStreamReader::_checkDataLen(size_t dataLen, si64 nVals)
+
+{
+  if (nVals < 0) {
+    return false;
+  }
+  return (dataLen == (size_t) nVals * 2 || dataLen == (size_t) nVals * 4);
+}
+
+///////////////////////////////////////////////
+// check the packet info at the start of buf
+
+StreamTsReader::packetStatus_t
+  IwrfStreamReader::_checkPacket(const ui08 *buf, size_t len,
+                                 size_t &packetLen)
+
+{
+
+  if (len < sizeof(iwrf_packet_info_t)) {
+    return PACKET_SHORT;
+  }
+  iwrf_packet_info_t info;
+  memcpy(&info, buf, sizeof(info));
+  if (!_isPacketId(info.id) ||
+      info.len_bytes < (si32) sizeof(iwrf_packet_info_t) ||
+      info.len_bytes > (si32) MAX_PACKET_BYTES) {
+    return PACKET_BAD;
+  }
+  size_t lenBytes = info.len_bytes;
+
+  // pulses and bursts - the length must match the data size
+  // in the header. Other packets are small.
+
+  if (info.id == IWRF_PULSE_HEADER_ID) {
+    if (len < sizeof(iwrf_pulse_header_t)) {
+      return PACKET_SHORT;
+    }
+    iwrf_pulse_header_t hdr;
+    memcpy(&hdr, buf, sizeof(hdr));
+    if (hdr.n_channels < 1 || hdr.n_channels > IWRF_MAX_CHAN ||
+        lenBytes < sizeof(hdr) ||
+        !_checkDataLen(lenBytes - sizeof(hdr), hdr.n_data)) {
+      return PACKET_BAD;
+    }
+  } else if (info.id == IWRF_BURST_HEADER_ID) {
+    if (len < sizeof(iwrf_burst_header_t)) {
+      return PACKET_SHORT;
+    }
+    iwrf_burst_header_t hdr;
+    memcpy(&hdr, buf, sizeof(hdr));
+    if (lenBytes < sizeof(hdr) ||
+        !_checkDataLen(lenBytes - sizeof(hdr), (si64) hdr.n_samples * 2)) {
+      return PACKET_BAD;
+    }
+  } else if (lenBytes > MAX_INFO_BYTES) {
+    return PACKET_BAD;
+  }
+
+  packetLen = lenBytes;
+  return PACKET_OK;
+
+}
+
+///////////////////////////////////////////////
+// find the next offset that starts a known packet id, or
+// may do so, cut off by the end of buf.
+//
+// The ids are stored as xx xx 77 77 - search for the first
+// 0x77 with memchr, then compare the whole id.
+
+size_t IwrfStreamReader::_findPacketStart(const ui08 *buf, size_t len)
+
+{
+
+  size_t pos = 2;
+  while (pos < len) {
+    const ui08 *hit = (const ui08 *) memchr(buf + pos, 0x77, len - pos);
+    if (hit == NULL) {
+      break;
+    }
+    size_t start = (hit - buf) - 2;
+    if (start + 4 > len) {
+      break;
+    }
+    si32 id;
+    memcpy(&id, buf + start, 4);
+    if (_isPacketId(id)) {
+      return start;
+    }
+    pos = (hit - buf) + 1;
+  }
+
+  // the last few bytes may start an id
+
+  for (size_t start = (len > 3 ? len - 3 : 0); start < len; start++) {
+    if (_isPacketIdPrefix(buf + start, len - start)) {
+      return start;
+    }
+  }
+  return len;
+
+}
+
+///////////////////////////////////////////////
+// decode packets - pulses are queued, the burst and info
+// packets update the reader state
+
+void IwrfStreamReader::_decodePackets(const vector<const ui08 *> &packets,
+                                      const vector<size_t> &lens)
+
+{
+
+  for (size_t ii = 0; ii < packets.size(); ii++) {
+
+    const ui08 *buf = packets[ii];
+    int len = (int) lens[ii];
+    iwrf_packet_info_t info;
+    memcpy(&info, buf, sizeof(info));
+
+    if (_filterRadarId != 0 && info.radar_id != _filterRadarId) {
+      continue;
+    }
+
+    if (info.id == IWRF_PULSE_HEADER_ID) {
+      IwrfTsPulse *pulse = new IwrfTsPulse(_info);
+      if (pulse->setFromBuffer(buf, len, true)) {
+        delete pulse;
+        _nDecodeErrors++;
+        continue;
+      }
+      _queuePulse(pulse);
+    } else if (info.id == IWRF_BURST_HEADER_ID) {
+      if (_burst.setFromBuffer(buf, len)) {
+        _nDecodeErrors++;
+      }
+    } else {
+      // ops info - types we do not use are ignored
+      _info.setFromBuffer(buf, len);
+    }
+
+  } // ii
+
+}
@@ -0,0 +1,78 @@
+/* *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* */
+/* ** Copyright UCAR (c) 1990 - 2016                                         */
+/* ** University Corporation for Atmospheric Research (UCAR)                 */
+/* ** National Center for Atmospheric Research (NCAR)                        */
+/* ** Boulder, Colorado, USA                                                 */
+/* ** BSD licence applies - redistribution and use in source and binary      */
+/* ** forms, with or without modification, are permitted provided that       */
+/* ** the following conditions are met:                                      */
+/* ** 1) If the software is modified to produce derivative works,            */
+/* ** such modified software should be clearly marked, so as not             */
+/* ** to confuse it with the version available from UCAR.                    */
+/* ** 2) Redistributions of source code must retain the above copyright      */
+/* ** notice, this list of conditions and the following disclaimer.          */
+/* ** 3) Redistributions in binary form must reproduce the above copyright   */
+/* ** notice, this list of conditions and the following disclaimer in the    */
+/* ** documentation and/or other materials provided with the distribution.   */
+/* ** 4) Neither the name of UCAR nor the names of its contributors,         */
+/* ** if any, may be used to endorse or promote products derived from        */
+/* ** this software without specific prior written permission.               */
+/* ** DISCLAIMER: THIS SOFTWARE IS PROVIDED "AS IS" AND WITHOUT ANY EXPRESS  */
+/* ** OR IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED      */
+/* ** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.    */
+/* *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* */
+#ifndef IWRFSTREAMREADER_H_
+#define IWRFSTREAMREADER_H_
+
+#include "StreamTsReader.h"
+
+/// Reads the raw IWRF time series stream from a TCP server.
+///
+/// Used in place of IwrfTsReaderTcp so that a damaged packet is
+/// skipped, and the bytes passed over counted, rather than taken
+/// as a read failure that drops the connection. Packets are
+/// expected in host byte order.
+///
+/// Only known IWRF packet ids are accepted, and pulse and burst
+/// lengths must agree with their headers, so that IQ data which
+/// happens to look like a packet id does not stall the reader
+/// waiting for a huge packet.
+
+class IwrfStreamReader : public StreamTsReader
+{
+
+public:
+
+  /// Constructor
+  /// @param host The server host
+  /// @param port The server port
+  /// @param radarId Keep only packets from this radar, 0 for all
+  IwrfStreamReader(const std::string &host, int port,
+                   int radarId, int debugLevel);
+
+  /// Destructor
+  virtual ~IwrfStreamReader();
+
+protected:
+
+  virtual packetStatus_t _checkPacket(const ui08 *buf, size_t len,
+                                      size_t &packetLen);
+  virtual size_t _findPacketStart(const ui08 *buf, size_t len);
+  virtual void _decodePackets(const std::vector<const ui08 *> &packets,
+                              const std::vector<size_t> &lens);
+
+private:
+
+  static const size_t MAX_PACKET_BYTES = 64 * 1024 * 1024;
+  static const size_t MAX_INFO_BYTES = 1024 * 1024;
+
+  static const si32 _packetIds[];
+  static const int _nPacketIds;
+
+  static bool _isPacketId(si32 id);
+  static bool _isPacketIdPrefix(const ui08 *buf, size_t len);
+  static bool _checkDataLen(size_t dataLen, si64 nVals);
+
+};
+
+#endif /*IWRFSTREAMREADER_H_*/
@@ -0,0 +1,252 @@
+// *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* 
+// ** Copyright UCAR (c) 1990 - 2016                                         
+// ** University Corporation for Atmospheric Research (UCAR)                 
+// ** National Center for Atmospheric Research (NCAR)                        
+// ** Boulder, Colorado, USA                                                 
+// ** BSD licence applies - redistribution and use in source and binary      
+// ** forms, with or without modification, are permitted provided that       
+// ** the following conditions are met:                                      
+// ** 1) If the software is modified to produce derivative works,            
+// ** such modified software should be clearly marked, so as not             
+// ** to confuse it with the version available from UCAR.                    
+// ** 2) Redistributions of source code must retain the above copyright      
+// ** notice, this list of conditions and the following disclaimer.          
+// ** 3) Redistributions in binary form must reproduce the above copyright   
+// ** notice, this list of conditions and the following disclaimer in the    
+// ** documentation and/or other materials provided with the distribution.   
+// ** 4) Neither the name of UCAR nor the names of its contributors,         
+// ** if any, may be used to endorse or promote products derived from        
+// ** this software without specific prior written permission.               
+// ** DISCLAIMER: THIS SOFTWARE IS PROVIDED "AS IS" AND WITHOUT ANY EXPRESS  
+// ** OR IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED      
+// ** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.    
+// *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* 
+#include "RangeTimeHistory.h"
+#include "ThreadTuning.h"
+#include <cstring>
+#include <cstdlib>
+#include <new>
+#include <iostream>
+using namespace std;
+
+RangeTimeHistory::RangeTimeHistory(int maxRows,
+                                   int maxGates,
+                                   double maxAgeSecs,
+                                   bool hugePages):
+        _maxRows(maxRows),
+        _maxGates(maxGates),
+        _maxAgeSecs(maxAgeSecs),
+        _next(0),
+        _nRows(0),
+        _rowGates(0),
+        _power(NULL),
+        _powerBytes(0)
+{
+
+  if (_maxRows < 1) {
+    _maxRows = 1;
+  }
+  if (_maxGates < 1) {
+    _maxGates = 1;
+  }
+
+  // sizes in size_t - the product overflows int well before
+  // the storage limit
+
+  if (getPowerBytes(_maxRows, _maxGates) > MAX_POWER_BYTES) {
+    _maxRows = MAX_POWER_BYTES / getPowerBytes(1, _maxGates);
+    if (_maxRows < 1) {
+      _maxRows = 1;
+      _maxGates = MAX_POWER_BYTES / getPowerBytes(1, 1);
+    }
+  }
+
+  // the huge page advice only works on memory not yet touched,
+  // so allocate, advise, and then zero
+
+  _powerBytes = getPowerBytes(_maxRows, _maxGates);
+  void *power = NULL;
+  if (posix_memalign(&power, HUGE_PAGE_BYTES, _powerBytes)) {
+    throw bad_alloc();
+  }
+  _power = (fl32 *) power;
+  if (hugePages) {
+    string errStr;
+    if (ThreadTuning::adviseHugePages(_power, _powerBytes, errStr)) {
+      cerr << "WARNING - RangeTimeHistory: " << errStr << endl;
+    }
+  }
+  memset(_power, 0, _powerBytes);
+
+  _nPulses.resize((size_t) _maxRows * MAX_CHANNELS, 0);
+  _times.resize(_maxRows, 0.0);
+  _nBins.resize(_maxRows, 0);
+  _strides.resize(_maxRows, 1);
+
+}
+
+RangeTimeHistory::~RangeTimeHistory()
+
+{
+  free(_power);
+}
+
+///////////////////////////////////////////////
+// power storage size
+
+size_t RangeTimeHistory::getPowerBytes(int maxRows, int maxGates)
+
+{
+  return (size_t) maxRows * MAX_CHANNELS * maxGates * sizeof(fl32);
+}
+
+///////////////////////////////////////////////
+// start a new row in the next slot
+
+void RangeTimeHistory::beginRow(double time, int nGates)
+
+{
+
+  int stride = (nGates + _maxGates - 1) / _maxGates;
+  if (stride < 1) {
+    stride = 1;
+  }
+  int nBins = (nGates + stride - 1) / stride;
+
+  _rowGates = nGates;
+  _times[_next] = time;
+  _strides[_next] = stride;
+  _nBins[_next] = nBins;
+
+  memset(&_power[_offset(_next, 0)], 0,
+         (size_t) MAX_CHANNELS * _maxGates * sizeof(fl32));
+  for (int ichan = 0; ichan < MAX_CHANNELS; ichan++) {
+    _nPulses[_next * MAX_CHANNELS + ichan] = 0;
+  }
+
+}
+
+///////////////////////////////////////////////
+// sum pulse power into the current row
+
+void RangeTimeHistory::addPulse(int chan, const fl32 *iq, int nGates)
+
+{
+
+  if (chan < 0 || chan >= MAX_CHANNELS || iq == NULL) {
+    return;
+  }
+
+  int stride = _strides[_next];
+  int nBins = _nBins[_next];
+  fl32 *power = &_power[_offset(_next, chan)];
+
+  int igate = 0;
+  for (int ibin = 0; ibin < nBins && igate < nGates; ibin++) {
+    int endGate = igate + stride;
+    if (endGate > nGates) {
+      endGate = nGates;
+    }
+    fl32 sum = 0.0;
+    for (; igate < endGate; igate++) {
+      fl32 ii = iq[igate * 2];
+      fl32 qq = iq[igate * 2 + 1];
+      sum += ii * ii + qq * qq;
+    }
+    power[ibin] += sum;
+  }
+
+  _nPulses[_next * MAX_CHANNELS + chan]++;
+
+}
+
+///////////////////////////////////////////////
+// convert sums to means and advance the ring
+
+void RangeTimeHistory::endRow()
+
+{
+
+  int stride = _strides[_next];
+  int nBins = _nBins[_next];
+
+  for (int ichan = 0; ichan < MAX_CHANNELS; ichan++) {
+    int nPulses = _nPulses[_next * MAX_CHANNELS + ichan];
+    if (nPulses == 0) {
+      continue;
+    }
+    fl32 scale = 1.0 / ((double) nPulses * stride);
+    fl32 *power = &_power[_offset(_next, ichan)];
+    for (int ibin = 0; ibin < nBins; ibin++) {
+      power[ibin] *= scale;
+    }
+    // last bin may hold fewer than stride gates
+    int nLast = _rowGates - (nBins - 1) * stride;
+    if (nBins > 0 && nLast > 0 && nLast < stride) {
+      power[nBins - 1] *= (fl32) stride / nLast;
+    }
+  }
+
+  double latest = _times[_next];
+  _next = (_next + 1) % _maxRows;
+  if (_nRows < _maxRows) {
+    _nRows++;
+  }
+
+  // age out old rows
+
+  if (_maxAgeSecs > 0) {
+    while (_nRows > 1 && latest - getRowTime(0) > _maxAgeSecs) {
+      _nRows--;
+    }
+  }
+
+}
+
+///////////////////////////////////////////////
+// get power for a row and channel
+
+const fl32 *RangeTimeHistory::getPower(int row, int chan) const
+
+{
+
+  if (row < 0 || row >= _nRows || chan < 0 || chan >= MAX_CHANNELS) {
+    return NULL;
+  }
+  int slot = _slot(row);
+  if (_nPulses[slot * MAX_CHANNELS + chan] == 0) {
+    return NULL;
+  }
+  return &_power[_offset(slot, chan)];
+
+}
+
+///////////////////////////////////////////////
+// copy a row
+
+void RangeTimeHistory::getRow(int row, row_t &rowOut) const
+
+{
+
+  rowOut.time = getRowTime(row);
+  rowOut.nBins = getRowNBins(row);
+  rowOut.gateStride = getRowGateStride(row);
+  for (int ichan = 0; ichan < MAX_CHANNELS; ichan++) {
+    const fl32 *power = getPower(row, ichan);
+    if (power == NULL) {
+      rowOut.power[ichan].clear();
+    } else {
+      rowOut.power[ichan].assign(power, power + rowOut.nBins);
+    }
+  }
+
+}
+
+///////////////////////////////////////////////
+// lock the power storage in memory
+
+int RangeTimeHistory::lockMemory(string &errStr)
+
+{
+  return ThreadTuning::lockBuffer(_power, _powerBytes, errStr);
+}
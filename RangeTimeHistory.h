@@ -0,0 +1,167 @@
+/* *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* */
+/* ** Copyright UCAR (c) 1990 - 2016                                         */
+/* ** University Corporation for Atmospheric Research (UCAR)                 */
+/* ** National Center for Atmospheric Research (NCAR)                        */
+/* ** Boulder, Colorado, USA                                                 */
+/* ** BSD licence applies - redistribution and use in source and binary      */
+/* ** forms, with or without modification, are permitted provided that       */
+/* ** the following conditions are met:                                      */
+/* ** 1) If the software is modified to produce derivative works,            */
+/* ** such modified software should be clearly marked, so as not             */
+/* ** to confuse it with the version available from UCAR.                    */
+/* ** 2) Redistributions of source code must retain the above copyright      */
+/* ** notice, this list of conditions and the following disclaimer.          */
+/* ** 3) Redistributions in binary form must reproduce the above copyright   */
+/* ** notice, this list of conditions and the following disclaimer in the    */
+/* ** documentation and/or other materials provided with the distribution.   */
+/* ** 4) Neither the name of UCAR nor the names of its contributors,         */
+/* ** if any, may be used to endorse or promote products derived from        */
+/* ** this software without specific prior written permission.               */
+/* ** DISCLAIMER: THIS SOFTWARE IS PROVIDED "AS IS" AND WITHOUT ANY EXPRESS  */
+/* ** OR IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED      */
+/* ** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.    */
+/* *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* */
+#ifndef RANGETIMEHISTORY_H_
+#define RANGETIMEHISTORY_H_
+
+#include <string>
+#include <vector>
+#include <dataport/port_types.h>
+
+/// A fixed-size ring of range profiles, one row per time series
+/// block, for range-time-intensity or waterfall displays.
+///
+/// Each row holds the mean power per gate for up to MAX_CHANNELS
+/// channels. All storage is allocated in the constructor. Long
+/// beams are averaged into at most maxGates bins, so memory does
+/// not depend on the radar's gate count. Adding a row costs
+/// O(gates) per pulse and does not touch earlier rows.
+///
+/// The ring is not locked - it is for the thread that fills it.
+/// Other threads, e.g. a display, work on copies from getRow().
+
+class RangeTimeHistory
+{
+
+public:
+
+  static const int MAX_CHANNELS = 4;
+
+  /// Limit on the power storage. Larger sizes are cut down to
+  /// fit, by reducing the number of rows.
+  static const size_t MAX_POWER_BYTES = 1024 * 1024 * 1024;
+
+  /// @return bytes of power storage for the given size
+  static size_t getPowerBytes(int maxRows, int maxGates);
+
+  /// A copy of one row
+  typedef struct {
+    double time;     // unix seconds
+    int nBins;       // range bins used
+    int gateStride;  // gates averaged into each bin
+    std::vector<fl32> power[MAX_CHANNELS]; // empty if no data
+  } row_t;
+
+  /// Constructor
+  /// @param maxRows The number of rows (blocks) retained
+  /// @param maxGates The number of range bins per row
+  /// @param maxAgeSecs Rows older than this, relative to the
+  /// newest row, are dropped. 0 keeps all maxRows rows.
+  /// @param hugePages Ask for huge pages to back the power
+  /// storage. The advice is given before the memory is first
+  /// touched, and a failure is only a warning.
+  RangeTimeHistory(int maxRows, int maxGates, double maxAgeSecs,
+                   bool hugePages = false);
+
+  /// Destructor
+  virtual ~RangeTimeHistory();
+
+  /// Start a new row, overwriting the oldest if the ring is full
+  /// @param time Row time, unix seconds
+  /// @param nGates The number of gates in the incoming pulses
+  void beginRow(double time, int nGates);
+
+  /// Accumulate the power of one pulse into the current row
+  /// @param chan Channel, 0 to MAX_CHANNELS - 1
+  /// @param iq IQ data, interleaved I and Q
+  /// @param nGates The number of gates in iq
+  void addPulse(int chan, const fl32 *iq, int nGates);
+
+  /// Complete the current row, converting sums to means
+  void endRow();
+
+  /// @return the number of completed rows held
+  int getNRows() const { return _nRows; }
+
+  /// @return the maximum number of rows
+  int getMaxRows() const { return _maxRows; }
+
+  /// @return the number of range bins per row
+  int getMaxGates() const { return _maxGates; }
+
+  /// @param row Row index, 0 is the oldest
+  /// @return the row time, unix seconds
+  double getRowTime(int row) const { return _times[_slot(row)]; }
+
+  /// @param row Row index, 0 is the oldest
+  /// @return the number of range bins used in the row
+  int getRowNBins(int row) const { return _nBins[_slot(row)]; }
+
+  /// @param row Row index, 0 is the oldest
+  /// @return the number of gates averaged into each bin
+  int getRowGateStride(int row) const { return _strides[_slot(row)]; }
+
+  /// @param row Row index, 0 is the oldest
+  /// @param chan Channel, 0 to MAX_CHANNELS - 1
+  /// @return mean power per bin, or NULL if the channel had no data
+  const fl32 *getPower(int row, int chan) const;
+
+  /// Copy a row out of the ring
+  /// @param row Row index, 0 is the oldest
+  void getRow(int row, row_t &rowOut) const;
+
+  /// Lock the power storage in memory.
+  /// @return 0 on success, -1 on failure
+  int lockMemory(std::string &errStr);
+
+private:
+
+  static const size_t HUGE_PAGE_BYTES = 2 * 1024 * 1024;
+
+  int _maxRows;
+  int _maxGates;
+  double _maxAgeSecs;
+
+  // ring state - _next is the slot the next row will use
+
+  int _next;
+  int _nRows;
+  int _rowGates; // gates in the row being built
+
+  // storage, indexed by slot
+
+  fl32 *_power; // [slot][chan][bin], aligned for huge pages
+  size_t _powerBytes;
+  std::vector<int> _nPulses; // [slot][chan]
+  std::vector<double> _times;
+  std::vector<int> _nBins;
+  std::vector<int> _strides;
+
+  int _slot(int row) const {
+    return (_next - _nRows + row + _maxRows) % _maxRows;
+  }
+
+  // offset of a slot and channel in _power
+
+  size_t _offset(int slot, int chan) const {
+    return ((size_t) slot * MAX_CHANNELS + chan) * _maxGates;
+  }
+
+  // not copyable - owns _power
+
+  RangeTimeHistory(const RangeTimeHistory &);
+  RangeTimeHistory &operator=(const RangeTimeHistory &);
+
+};
+
+#endif /*RANGETIMEHISTORY_H_*/
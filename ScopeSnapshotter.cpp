@@ -0,0 +1,147 @@
+// *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* 
+// ** Copyright UCAR (c) 1990 - 2016                                         
+// ** University Corporation for Atmospheric Research (UCAR)                 
+// ** National Center for Atmospheric Research (NCAR)                        
+// ** Boulder, Colorado, USA                                                 
+// ** BSD licence applies - redistribution and use in source and binary      
+// ** forms, with or without modification, are permitted provided that       
+// ** the following conditions are met:                                      
+// ** 1) If the software is modified to produce derivative works,            
+// ** such modified software should be clearly marked, so as not             
+// ** to confuse it with the version available from UCAR.                    
+// ** 2) Redistributions of source code must retain the above copyright      
+// ** notice, this list of conditions and the following disclaimer.          
+// ** 3) Redistributions in binary form must reproduce the above copyright   
+// ** notice, this list of conditions and the following disclaimer in the    
+// ** documentation and/or other materials provided with the distribution.   
+// ** 4) Neither the name of UCAR nor the names of its contributors,         
+// ** if any, may be used to endorse or promote products derived from        
+// ** this software without specific prior written permission.               
+// ** DISCLAIMER: THIS SOFTWARE IS PROVIDED "AS IS" AND WITHOUT ANY EXPRESS  
+// ** OR IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED      
+// ** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.    
+// *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* 
+#include "ScopeSnapshotter.h"
+#include <QDateTime>
+#include <QDir>
+#include <QPixmap>
+#include <QTimer>
+#include <QMutexLocker>
+#include <iostream>
+using namespace std;
+
+ScopeSnapshotter::ScopeSnapshotter(QWidget &scope,
+                                   const string &saveDir,
+                                   const string &prefix,
+                                   double intervalSecs,
+                                   int maxQueue,
+                                   int debugLevel):
+        _scope(scope),
+        _saveDir(QString::fromStdString(saveDir)),
+        _prefix(QString::fromStdString(prefix)),
+        _maxQueue(maxQueue),
+        _debugLevel(debugLevel),
+        _stop(false),
+        _nSaved(0),
+        _nDropped(0)
+{
+
+  if (_maxQueue < 1) {
+    _maxQueue = 1;
+  }
+  if (intervalSecs < MIN_INTERVAL_SECS) {
+    intervalSecs = MIN_INTERVAL_SECS;
+  }
+
+  // spaces are awkward in file names
+
+  _prefix.replace(' ', '_');
+
+  // the timer lives on the GUI thread, with this object
+
+  QTimer *timer = new QTimer(this);
+  connect(timer, SIGNAL(timeout()), this, SLOT(takeSnapshot()));
+  timer->start((int) (intervalSecs * 1000.0));
+
+  start(QThread::LowPriority);
+
+}
+
+ScopeSnapshotter::~ScopeSnapshotter()
+
+{
+
+  {
+    QMutexLocker locker(&_mutex);
+    _stop = true;
+    _queueNotEmpty.wakeAll();
+  }
+  wait();
+
+}
+
+//////////////////////////////////////////////////////////////
+// capture the scope - on the GUI thread
+
+void ScopeSnapshotter::takeSnapshot()
+{
+
+  {
+    QMutexLocker locker(&_mutex);
+    if ((int) _queue.size() >= _maxQueue) {
+      _nDropped.ref();
+      if (_debugLevel > 0) {
+        cerr << "WARNING - ScopeSnapshotter: queue full, dropping frame"
+             << endl;
+      }
+      return;
+    }
+  }
+
+  frame_t frame;
+  frame.image = _scope.grab().toImage();
+  QString timeStr =
+    QDateTime::currentDateTimeUtc().toString("yyyyMMdd_HHmmss");
+  frame.path = QDir(_saveDir).filePath(_prefix + "_" + timeStr + ".png");
+
+  QMutexLocker locker(&_mutex);
+  _queue.push_back(frame);
+  _queueNotEmpty.wakeOne();
+
+}
+
+//////////////////////////////////////////////////////////////
+// encode and write images - on this thread
+
+void ScopeSnapshotter::run()
+{
+
+  while (true) {
+
+    frame_t frame;
+    {
+      QMutexLocker locker(&_mutex);
+      while (_queue.empty() && !_stop) {
+        _queueNotEmpty.wait(&_mutex);
+      }
+      if (_queue.empty()) {
+        // stopped, and nothing left to write
+        return;
+      }
+      frame = _queue.front();
+      _queue.pop_front();
+    }
+
+    if (frame.image.save(frame.path, "PNG")) {
+      _nSaved.ref();
+      if (_debugLevel > 0) {
+        cerr << "Saved snapshot: " << frame.path.toStdString() << endl;
+      }
+    } else {
+      cerr << "WARNING - ScopeSnapshotter: cannot write "
+           << frame.path.toStdString() << endl;
+    }
+
+  } // while
+
+}
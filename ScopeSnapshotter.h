@@ -0,0 +1,113 @@
+/* *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* */
+/* ** Copyright UCAR (c) 1990 - 2016                                         */
+/* ** University Corporation for Atmospheric Research (UCAR)                 */
+/* ** National Center for Atmospheric Research (NCAR)                        */
+/* ** Boulder, Colorado, USA                                                 */
+/* ** BSD licence applies - redistribution and use in source and binary      */
+/* ** forms, with or without modification, are permitted provided that       */
+/* ** the following conditions are met:                                      */
+/* ** 1) If the software is modified to produce derivative works,            */
+/* ** such modified software should be clearly marked, so as not             */
+/* ** to confuse it with the version available from UCAR.                    */
+/* ** 2) Redistributions of source code must retain the above copyright      */
+/* ** notice, this list of conditions and the following disclaimer.          */
+/* ** 3) Redistributions in binary form must reproduce the above copyright   */
+/* ** notice, this list of conditions and the following disclaimer in the    */
+/* ** documentation and/or other materials provided with the distribution.   */
+/* ** 4) Neither the name of UCAR nor the names of its contributors,         */
+/* ** if any, may be used to endorse or promote products derived from        */
+/* ** this software without specific prior written permission.               */
+/* ** DISCLAIMER: THIS SOFTWARE IS PROVIDED "AS IS" AND WITHOUT ANY EXPRESS  */
+/* ** OR IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED      */
+/* ** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.    */
+/* *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* */
+#ifndef SCOPESNAPSHOTTER_H_
+#define SCOPESNAPSHOTTER_H_
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
+#include <QImage>
+#include <QString>
+#include <QWidget>
+
+#include <string>
+#include <deque>
+
+/// Saves images of the scope at a fixed interval, for unattended
+/// monitoring.
+///
+/// The scope is rendered to an image on the GUI thread when the
+/// timer fires. PNG encoding and the file write happen in run(),
+/// on this thread. The queue between them is bounded: if the disk
+/// falls behind, new frames are dropped rather than holding up the
+/// display.
+
+class ScopeSnapshotter : public QThread
+{
+
+  Q_OBJECT
+
+public:
+
+  /// Shortest interval - file names are to the second
+  static const int MIN_INTERVAL_SECS = 1;
+
+  /// Constructor
+  /// @param scope The widget to capture
+  /// @param saveDir Directory for the images
+  /// @param prefix File name prefix
+  /// @param intervalSecs Time between snapshots, at least
+  /// MIN_INTERVAL_SECS
+  /// @param maxQueue Maximum images waiting to be written
+  ScopeSnapshotter(QWidget &scope,
+                   const std::string &saveDir,
+                   const std::string &prefix,
+                   double intervalSecs,
+                   int maxQueue,
+                   int debugLevel);
+
+  /// Destructor - writes out the queue, then stops the thread
+  virtual ~ScopeSnapshotter();
+
+  /// @return the number of images written
+  int getNSaved() const { return _nSaved.loadAcquire(); }
+
+  /// @return the number of frames dropped because the queue was full
+  int getNDropped() const { return _nDropped.loadAcquire(); }
+
+public slots:
+
+  /// Capture the scope and queue the image for writing
+  void takeSnapshot();
+
+protected:
+
+  /// Write queued images until stopped
+  virtual void run();
+
+private:
+
+  typedef struct {
+    QImage image;
+    QString path;
+  } frame_t;
+
+  QWidget &_scope;
+  QString _saveDir;
+  QString _prefix;
+  int _maxQueue;
+  int _debugLevel;
+
+  QMutex _mutex;
+  QWaitCondition _queueNotEmpty;
+  std::deque<frame_t> _queue;
+  bool _stop;
+
+  QAtomicInt _nSaved;   // written on this thread, read on the GUI thread
+  QAtomicInt _nDropped;
+
+};
+
+#endif /*SCOPESNAPSHOTTER_H_*/
@@ -0,0 +1,362 @@
+// *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* 
+// ** Copyright UCAR (c) 1990 - 2016                                         
+// ** University Corporation for Atmospheric Research (UCAR)                 
+// ** National Center for Atmospheric Research (NCAR)                        
+// ** Boulder, Colorado, USA                                                 
+// ** BSD licence applies - redistribution and use in source and binary      
+// ** forms, with or without modification, are permitted provided that       
+// ** the following conditions are met:                                      
+// ** 1) If the software is modified to produce derivative works,            
+// ** such modified software should be clearly marked, so as not             
+// ** to confuse it with the version available from UCAR.                    
+// ** 2) Redistributions of source code must retain the above copyright      
+// ** notice, this list of conditions and the following disclaimer.          
+// ** 3) Redistributions in binary form must reproduce the above copyright   
+// ** notice, this list of conditions and the following disclaimer in the    
+// ** documentation and/or other materials provided with the distribution.   
+// ** 4) Neither the name of UCAR nor the names of its contributors,         
+// ** if any, may be used to endorse or promote products derived from        
+// ** this software without specific prior written permission.               
+// ** DISCLAIMER: THIS SOFTWARE IS PROVIDED "AS IS" AND WITHOUT ANY EXPRESS  
+// ** OR IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED      
+// ** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.    
+// *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* 
+#include "StreamTsReader.h"
+#include "ThreadTuning.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+using namespace std;
+
+StreamTsReader::StreamTsReader(const string &host,
+                               int port,
+                               int radarId,
+                               int debugLevel):
+        _filterRadarId(radarId),
+        _debugLevel(debugLevel),
+        _nDecodeErrors(0),
+        _host(host),
+        _port(port),
+        _fd(-1),
+        _buf(BUFFER_BYTES),
+        _nBuf(0),
+        _lockBuf(false),
+        _inResync(false),
+        _dataWaiting(false),
+        _lastFromBacklog(false),
+        _nBytesIn(0),
+        _nBytesSkipped(0),
+        _nResyncs(0)
+{
+  _timedOut = false;
+}
+
+StreamTsReader::~StreamTsReader()
+
+{
+  reset();
+}
+
+///////////////////////////////////////////////
+// close and drop queued pulses
+
+void StreamTsReader::reset()
+
+{
+  _close();
+  for (size_t ii = 0; ii < _queue.size(); ii++) {
+    delete _queue[ii];
+  }
+  _queue.clear();
+}
+
+///////////////////////////////////////////////
+// lock the input buffer
+
+int StreamTsReader::lockBuffers(string &errStr)
+
+{
+  _lockBuf = true;
+  return ThreadTuning::lockBuffer(&_buf[0], _buf.size(), errStr);
+}
+
+///////////////////////////////////////////////
+// get next pulse
+//
+// returns NULL on timeout or failure
+
+IwrfTsPulse *StreamTsReader::getNextPulse(bool /* convertToFloat = false */)
+
+{
+
+  // pulses are always float
+
+  _lastFromBacklog = true;
+  if (_queue.empty()) {
+
+    _timedOut = false;
+    if (_fd < 0 && _open()) {
+      return NULL;
+    }
+    if (_readAvailable()) {
+      _close();
+      return NULL;
+    }
+    _extractPackets();
+
+    if (_queue.empty()) {
+      // nothing complete yet
+      _timedOut = true;
+      return NULL;
+    }
+    _lastFromBacklog = _dataWaiting;
+
+  }
+
+  _timedOut = false;
+  IwrfTsPulse *pulse = _queue.front();
+  _queue.pop_front();
+  return pulse;
+
+}
+
+///////////////////////////////////////////////
+// connect to the server
+//
+// returns 0 on success, -1 on failure
+
+int StreamTsReader::_open()
+
+{
+
+  char portStr[32];
+  snprintf(portStr, sizeof(portStr), "%d", _port);
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo *addrs = NULL;
+  int iret = getaddrinfo(_host.c_str(), portStr, &hints, &addrs);
+  if (iret != 0) {
+    cerr << "ERROR - StreamTsReader: cannot resolve " << _host
+         << ": " << gai_strerror(iret) << endl;
+    return -1;
+  }
+
+  for (struct addrinfo *addr = addrs; addr != NULL; addr = addr->ai_next) {
+
+    int fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+    if (fd < 0) {
+      continue;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    // connect, waiting a limited time
+
+    int err = 0;
+    if (connect(fd, addr->ai_addr, addr->ai_addrlen) != 0) {
+      err = errno;
+      if (err == EINPROGRESS) {
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLOUT;
+        if (poll(&pfd, 1, CONNECT_MSECS) == 1) {
+          socklen_t errLen = sizeof(err);
+          getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &errLen);
+        } else {
+          err = ETIMEDOUT;
+        }
+      }
+    }
+    if (err == 0) {
+      _fd = fd;
+      break;
+    }
+    ::close(fd);
+    if (_debugLevel > 0) {
+      cerr << "ERROR - StreamTsReader: cannot connect to "
+           << _host << ":" << _port << ": " << strerror(err) << endl;
+    }
+
+  }
+
+  freeaddrinfo(addrs);
+  if (_fd < 0) {
+    return -1;
+  }
+  return 0;
+
+}
+
+void StreamTsReader::_close()
+
+{
+  if (_fd >= 0) {
+    ::close(_fd);
+    _fd = -1;
+  }
+  _nBuf = 0;
+  _inResync = false;
+}
+
+///////////////////////////////////////////////
+// wait briefly for data, then read all that is waiting,
+// up to the free space in the buffer
+//
+// returns 0 on success, -1 if the connection has failed
+
+int StreamTsReader::_readAvailable()
+
+{
+
+  // check first without waiting, to tell data that was already
+  // there from data that arrived while we waited
+
+  struct pollfd pfd;
+  pfd.fd = _fd;
+  pfd.events = POLLIN;
+  int nReady = poll(&pfd, 1, 0);
+  _dataWaiting = (nReady > 0);
+  if (nReady == 0) {
+    nReady = poll(&pfd, 1, WAIT_MSECS);
+  }
+  if (nReady < 0) {
+    return (errno == EINTR) ? 0 : -1;
+  }
+  if (nReady == 0) {
+    return 0;
+  }
+
+  while (_nBuf < _buf.size()) {
+    ssize_t nRead = recv(_fd, &_buf[_nBuf], _buf.size() - _nBuf,
+                         MSG_DONTWAIT);
+    if (nRead > 0) {
+      _nBuf += nRead;
+      _nBytesIn += nRead;
+    } else if (nRead == 0) {
+      if (_debugLevel > 0) {
+        cerr << "StreamTsReader: connection closed by "
+             << _host << ":" << _port << endl;
+      }
+      return -1;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      break;
+    } else if (errno != EINTR) {
+      cerr << "ERROR - StreamTsReader: read failed from "
+           << _host << ":" << _port << ": " << strerror(errno) << endl;
+      return -1;
+    }
+  }
+
+  return 0;
+
+}
+
+///////////////////////////////////////////////
+// pass the complete packets in the buffer to the subclass,
+// skipping damaged data, and keep the partial packet at the end
+
+void StreamTsReader::_extractPackets()
+
+{
+
+  vector<const ui08 *> packets;
+  vector<size_t> lens;
+
+  size_t pos = 0;
+  size_t needLen = 0;
+  while (pos < _nBuf) {
+
+    const ui08 *ptr = &_buf[pos];
+    size_t avail = _nBuf - pos;
+    size_t packetLen = 0;
+    packetStatus_t status = _checkPacket(ptr, avail, packetLen);
+
+    if (status == PACKET_SHORT) {
+      break;
+    }
+
+    if (status == PACKET_BAD) {
+      // skip to the next possible packet start
+      size_t nSkip = 1 + _findPacketStart(ptr + 1, avail - 1);
+      _nBytesSkipped += nSkip;
+      if (!_inResync) {
+        _nResyncs++;
+        _inResync = true;
+      }
+      if (_debugLevel > 1) {
+        cerr << "StreamTsReader: resync, skipped " << nSkip
+             << " bytes" << endl;
+      }
+      pos += nSkip;
+      continue;
+    }
+
+    _inResync = false;
+    if (avail < packetLen) {
+      // wait for the rest
+      needLen = packetLen;
+      break;
+    }
+    packets.push_back(ptr);
+    lens.push_back(packetLen);
+    pos += packetLen;
+
+  }
+
+  if (packets.size() > 0) {
+    _decodePackets(packets, lens);
+  }
+
+  // keep the remainder for the next read
+
+  if (pos > 0) {
+    _nBuf -= pos;
+    memmove(&_buf[0], &_buf[pos], _nBuf);
+  }
+
+  // make room for a packet larger than the buffer, and give the
+  // memory back once it has gone - e.g. after a resync on data
+  // that looked like a large packet
+
+  if (needLen > _buf.size()) {
+    _resizeBuffer(needLen);
+  } else if (_buf.size() > BUFFER_BYTES &&
+             needLen <= BUFFER_BYTES && _nBuf <= BUFFER_BYTES) {
+    _resizeBuffer(BUFFER_BYTES);
+  }
+
+}
+
+///////////////////////////////////////////////
+// reallocate the buffer, keeping its contents, and lock the
+// new one if the old one was
+
+void StreamTsReader::_resizeBuffer(size_t nBytes)
+
+{
+
+  string errStr;
+  if (_lockBuf) {
+    ThreadTuning::unlockBuffer(&_buf[0], _buf.size(), errStr);
+  }
+
+  vector<ui08> buf(nBytes);
+  memcpy(&buf[0], &_buf[0], _nBuf);
+  _buf.swap(buf);
+
+  if (_lockBuf && ThreadTuning::lockBuffer(&_buf[0], _buf.size(), errStr)) {
+    cerr << "WARNING - StreamTsReader: " << errStr << endl;
+  }
+  if (_debugLevel > 0) {
+    cerr << "StreamTsReader: input buffer now " << nBytes
+         << " bytes" << endl;
+  }
+
+}
@@ -0,0 +1,155 @@
+/* *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* */
+/* ** Copyright UCAR (c) 1990 - 2016                                         */
+/* ** University Corporation for Atmospheric Research (UCAR)                 */
+/* ** National Center for Atmospheric Research (NCAR)                        */
+/* ** Boulder, Colorado, USA                                                 */
+/* ** BSD licence applies - redistribution and use in source and binary      */
+/* ** forms, with or without modification, are permitted provided that       */
+/* ** the following conditions are met:                                      */
+/* ** 1) If the software is modified to produce derivative works,            */
+/* ** such modified software should be clearly marked, so as not             */
+/* ** to confuse it with the version available from UCAR.                    */
+/* ** 2) Redistributions of source code must retain the above copyright      */
+/* ** notice, this list of conditions and the following disclaimer.          */
+/* ** 3) Redistributions in binary form must reproduce the above copyright   */
+/* ** notice, this list of conditions and the following disclaimer in the    */
+/* ** documentation and/or other materials provided with the distribution.   */
+/* ** 4) Neither the name of UCAR nor the names of its contributors,         */
+/* ** if any, may be used to endorse or promote products derived from        */
+/* ** this software without specific prior written permission.               */
+/* ** DISCLAIMER: THIS SOFTWARE IS PROVIDED "AS IS" AND WITHOUT ANY EXPRESS  */
+/* ** OR IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED      */
+/* ** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.    */
+/* *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* */
+#ifndef STREAMTSREADER_H_
+#define STREAMTSREADER_H_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <radar/IwrfTsInfo.hh>
+#include <radar/IwrfTsPulse.hh>
+#include <radar/IwrfTsReader.hh>
+
+/// Base for time series readers on a TCP byte stream of
+/// length-prefixed packets.
+///
+/// The socket is non-blocking. Each getNextPulse() with an empty
+/// queue waits at most WAIT_MSECS for data, reads what is waiting,
+/// and keeps any partial packet for the next call. Complete packets
+/// are handed to the subclass to decode.
+///
+/// If a packet header fails the subclass check, the stream is
+/// scanned forward for the next possible packet start, and the
+/// bytes passed over are counted - the connection is kept. Only a
+/// socket error or close shuts the connection, after which
+/// getNextPulse() returns NULL without a timeout so that the
+/// caller can reconnect.
+
+class StreamTsReader : public IwrfTsReader
+{
+
+public:
+
+  /// Constructor
+  /// @param host The server host
+  /// @param port The server port
+  /// @param radarId Keep only packets from this radar, 0 for all
+  StreamTsReader(const std::string &host, int port,
+                 int radarId, int debugLevel);
+
+  /// Destructor
+  virtual ~StreamTsReader();
+
+  /// Get the next pulse, converted to floats.
+  /// Returns NULL on timeout or failure - check getTimedOut().
+  virtual IwrfTsPulse *getNextPulse(bool convertToFloat = false);
+
+  /// Close the connection and drop queued pulses
+  virtual void reset();
+
+  /// Lock the input buffer in memory. A packet larger than the
+  /// buffer reallocates it, and it is shrunk back once the packet
+  /// has gone - it is locked again each time.
+  /// @return 0 on success, -1 on failure
+  int lockBuffers(std::string &errStr);
+
+  /// @return bytes read from the socket
+  si64 getNBytesIn() const { return _nBytesIn; }
+
+  /// @return bytes skipped while resynchronising
+  si64 getNBytesSkipped() const { return _nBytesSkipped; }
+
+  /// @return number of times the stream lost packet sync
+  int getNResyncs() const { return _nResyncs; }
+
+  /// @return packets that failed to decode
+  int getNDecodeErrors() const { return _nDecodeErrors; }
+
+  /// @return true if the last pulse was already waiting when it
+  /// was asked for - queued here, or in the socket - rather than
+  /// arriving while we waited. A delay before such a pulse was
+  /// ours, not the network's.
+  bool getLastFromBacklog() const { return _lastFromBacklog; }
+
+protected:
+
+  typedef enum {
+    PACKET_OK,    ///< valid header, packetLen is set
+    PACKET_BAD,   ///< not a packet start
+    PACKET_SHORT  ///< need more bytes to decide
+  } packetStatus_t;
+
+  /// Check for a packet header at the start of buf.
+  virtual packetStatus_t _checkPacket(const ui08 *buf, size_t len,
+                                      size_t &packetLen) = 0;
+
+  /// @return offset of the next possible packet start in buf,
+  /// or len if there is none.
+  virtual size_t _findPacketStart(const ui08 *buf, size_t len) = 0;
+
+  /// Decode complete packets, in stream order, queueing the
+  /// pulses with _queuePulse(). The packet memory is only valid
+  /// for the duration of the call.
+  virtual void _decodePackets(const std::vector<const ui08 *> &packets,
+                              const std::vector<size_t> &lens) = 0;
+
+  /// Add a decoded pulse to the output queue - takes ownership
+  void _queuePulse(IwrfTsPulse *pulse) { _queue.push_back(pulse); }
+
+  int _filterRadarId;
+  int _debugLevel;
+  int _nDecodeErrors;
+  IwrfTsInfo _info;
+
+private:
+
+  static const int WAIT_MSECS = 50;
+  static const int CONNECT_MSECS = 1000;
+  static const size_t BUFFER_BYTES = 8 * 1024 * 1024;
+
+  std::string _host;
+  int _port;
+  int _fd;
+
+  std::vector<ui08> _buf; // bytes read but not yet decoded
+  size_t _nBuf;
+  bool _lockBuf;
+  bool _inResync;
+  bool _dataWaiting; // socket had data before we waited on it
+  bool _lastFromBacklog;
+  std::deque<IwrfTsPulse *> _queue;
+
+  si64 _nBytesIn;
+  si64 _nBytesSkipped;
+  int _nResyncs;
+
+  int _open();
+  void _close();
+  int _readAvailable();
+  void _extractPackets();
+  void _resizeBuffer(size_t nBytes);
+
+};
+
+#endif /*STREAMTSREADER_H_*/
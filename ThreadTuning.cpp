@@ -0,0 +1,257 @@
+// *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* 
+// ** Copyright UCAR (c) 1990 - 2016                                         
+// ** University Corporation for Atmospheric Research (UCAR)                 
+// ** National Center for Atmospheric Research (NCAR)                        
+// ** Boulder, Colorado, USA                                                 
+// ** BSD licence applies - redistribution and use in source and binary      
+// ** forms, with or without modification, are permitted provided that       
+// ** the following conditions are met:                                      
+// ** 1) If the software is modified to produce derivative works,            
+// ** such modified software should be clearly marked, so as not             
+// ** to confuse it with the version available from UCAR.                    
+// ** 2) Redistributions of source code must retain the above copyright      
+// ** notice, this list of conditions and the following disclaimer.          
+// ** 3) Redistributions in binary form must reproduce the above copyright   
+// ** notice, this list of conditions and the following disclaimer in the    
+// ** documentation and/or other materials provided with the distribution.   
+// ** 4) Neither the name of UCAR nor the names of its contributors,         
+// ** if any, may be used to endorse or promote products derived from        
+// ** this software without specific prior written permission.               
+// ** DISCLAIMER: THIS SOFTWARE IS PROVIDED "AS IS" AND WITHOUT ANY EXPRESS  
+// ** OR IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED      
+// ** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.    
+// *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* 
+#include "ThreadTuning.h"
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+using namespace std;
+
+// set in the threads tuned through this class
+
+static thread_local bool _tuned = false;
+
+///////////////////////////////////////////////
+// the cpus before any thread was pinned - taken on first use,
+// which pinToCpus() makes sure is before it pins
+
+static const cpu_set_t &_untunedCpus()
+{
+  struct cpus_t {
+    cpu_set_t set;
+    cpus_t() {
+      CPU_ZERO(&set);
+      if (sched_getaffinity(0, sizeof(set), &set)) {
+        CPU_ZERO(&set);
+      }
+    }
+  };
+  static const cpus_t cpus;
+  return cpus.set;
+}
+
+///////////////////////////////////////////////
+// parse a cpu list
+
+int ThreadTuning::parseCpuList(const string &cpuList,
+                               vector<int> &cpus,
+                               string &errStr)
+
+{
+
+  cpus.clear();
+  size_t pos = 0;
+  while (pos < cpuList.size()) {
+    size_t end = cpuList.find(',', pos);
+    if (end == string::npos) {
+      end = cpuList.size();
+    }
+    string item = cpuList.substr(pos, end - pos);
+    int first, last;
+    char extra;
+    if (sscanf(item.c_str(), "%d-%d%c", &first, &last, &extra) == 2) {
+      // range
+    } else if (sscanf(item.c_str(), "%d%c", &first, &extra) == 1) {
+      last = first;
+    } else {
+      errStr = "bad cpu list: " + cpuList;
+      return -1;
+    }
+    if (first < 0 || last < first || last >= CPU_SETSIZE) {
+      errStr = "bad cpu list: " + cpuList;
+      return -1;
+    }
+    for (int cpu = first; cpu <= last; cpu++) {
+      cpus.push_back(cpu);
+    }
+    pos = end + 1;
+  }
+
+  if (cpus.empty()) {
+    errStr = "empty cpu list";
+    return -1;
+  }
+  return 0;
+
+}
+
+///////////////////////////////////////////////
+// pin calling thread to cpus
+
+int ThreadTuning::pinToCpus(const vector<int> &cpus, string &errStr)
+
+{
+
+  _untunedCpus();
+
+  cpu_set_t cpuSet;
+  CPU_ZERO(&cpuSet);
+  for (size_t ii = 0; ii < cpus.size(); ii++) {
+    CPU_SET(cpus[ii], &cpuSet);
+  }
+
+  int err = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+  if (err != 0) {
+    errStr = string("cannot set cpu affinity: ") + strerror(err);
+    return -1;
+  }
+  _tuned = true;
+  return 0;
+
+}
+
+///////////////////////////////////////////////
+// set SCHED_FIFO for calling thread
+
+int ThreadTuning::setFifoPriority(int priority, string &errStr)
+
+{
+
+  int minPriority = sched_get_priority_min(SCHED_FIFO);
+  int maxPriority = sched_get_priority_max(SCHED_FIFO);
+  if (priority < minPriority) {
+    priority = minPriority;
+  }
+  if (priority > maxPriority) {
+    priority = maxPriority;
+  }
+
+  struct sched_param param;
+  memset(&param, 0, sizeof(param));
+  param.sched_priority = priority;
+  int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+  if (err != 0) {
+    errStr = string("cannot set SCHED_FIFO: ") + strerror(err);
+    return -1;
+  }
+  _tuned = true;
+  return 0;
+
+}
+
+///////////////////////////////////////////////
+// clear cpu pinning and priority for calling thread
+
+int ThreadTuning::clearTuning(string &errStr)
+
+{
+
+  const cpu_set_t &cpuSet = _untunedCpus();
+  if (CPU_COUNT(&cpuSet) == 0) {
+    errStr = "cannot get process cpus";
+    return -1;
+  }
+  int err = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+  if (err != 0) {
+    errStr = string("cannot clear cpu affinity: ") + strerror(err);
+    return -1;
+  }
+
+  struct sched_param param;
+  memset(&param, 0, sizeof(param));
+  param.sched_priority = 0;
+  err = pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+  if (err != 0) {
+    errStr = string("cannot clear SCHED_FIFO: ") + strerror(err);
+    return -1;
+  }
+  _tuned = false;
+  return 0;
+
+}
+
+///////////////////////////////////////////////
+// was the calling thread tuned here
+
+bool ThreadTuning::isTuned()
+
+{
+  return _tuned;
+}
+
+///////////////////////////////////////////////
+// lock a buffer in memory
+
+int ThreadTuning::lockBuffer(const void *addr, size_t len, string &errStr)
+
+{
+
+  if (len == 0) {
+    return 0;
+  }
+  if (mlock(addr, len)) {
+    errStr = string("cannot lock buffer in memory: ") + strerror(errno);
+    return -1;
+  }
+  return 0;
+
+}
+
+///////////////////////////////////////////////
+// unlock a buffer
+
+int ThreadTuning::unlockBuffer(const void *addr, size_t len, string &errStr)
+
+{
+
+  if (len == 0) {
+    return 0;
+  }
+  if (munlock(addr, len)) {
+    errStr = string("cannot unlock buffer: ") + strerror(errno);
+    return -1;
+  }
+  return 0;
+
+}
+
+///////////////////////////////////////////////
+// advise huge pages for the page-aligned part of a buffer
+
+int ThreadTuning::adviseHugePages(void *addr, size_t len, string &errStr)
+
+{
+
+#ifdef MADV_HUGEPAGE
+  size_t pageSize = sysconf(_SC_PAGESIZE);
+  size_t start = ((size_t) addr + pageSize - 1) & ~(pageSize - 1);
+  size_t end = ((size_t) addr + len) & ~(pageSize - 1);
+  if (end <= start) {
+    return 0;
+  }
+  if (madvise((void *) start, end - start, MADV_HUGEPAGE)) {
+    errStr = string("cannot advise huge pages: ") + strerror(errno);
+    return -1;
+  }
+  return 0;
+#else
+  errStr = "huge pages not supported on this platform";
+  return -1;
+#endif
+
+}
@@ -0,0 +1,84 @@
+/* *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* */
+/* ** Copyright UCAR (c) 1990 - 2016                                         */
+/* ** University Corporation for Atmospheric Research (UCAR)                 */
+/* ** National Center for Atmospheric Research (NCAR)                        */
+/* ** Boulder, Colorado, USA                                                 */
+/* ** BSD licence applies - redistribution and use in source and binary      */
+/* ** forms, with or without modification, are permitted provided that       */
+/* ** the following conditions are met:                                      */
+/* ** 1) If the software is modified to produce derivative works,            */
+/* ** such modified software should be clearly marked, so as not             */
+/* ** to confuse it with the version available from UCAR.                    */
+/* ** 2) Redistributions of source code must retain the above copyright      */
+/* ** notice, this list of conditions and the following disclaimer.          */
+/* ** 3) Redistributions in binary form must reproduce the above copyright   */
+/* ** notice, this list of conditions and the following disclaimer in the    */
+/* ** documentation and/or other materials provided with the distribution.   */
+/* ** 4) Neither the name of UCAR nor the names of its contributors,         */
+/* ** if any, may be used to endorse or promote products derived from        */
+/* ** this software without specific prior written permission.               */
+/* ** DISCLAIMER: THIS SOFTWARE IS PROVIDED "AS IS" AND WITHOUT ANY EXPRESS  */
+/* ** OR IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED      */
+/* ** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.    */
+/* *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* */
+#ifndef THREADTUNING_H_
+#define THREADTUNING_H_
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+/// Scheduling and memory settings for the ingest thread.
+///
+/// Each call applies to the calling thread, or to the given buffer
+/// for memory locking. All return 0 on success and -1 on failure,
+/// with the reason in errStr, so that callers can carry on
+/// without the setting when they lack the privileges for it.
+
+class ThreadTuning
+{
+
+public:
+
+  /// Parse a cpu list such as "2,3" or "0-3,6".
+  /// @return 0 on success, -1 on a bad list
+  static int parseCpuList(const std::string &cpuList,
+                          std::vector<int> &cpus,
+                          std::string &errStr);
+
+  /// Pin the calling thread to the given cpus
+  static int pinToCpus(const std::vector<int> &cpus,
+                       std::string &errStr);
+
+  /// Run the calling thread under SCHED_FIFO
+  /// @param priority 1 (lowest) to 99 (highest)
+  static int setFifoPriority(int priority, std::string &errStr);
+
+  /// Put the calling thread back on the cpus the process had
+  /// before any thread was pinned, under the default scheduler -
+  /// for threads started from a tuned thread, which inherit its
+  /// settings
+  static int clearTuning(std::string &errStr);
+
+  /// @return true if the calling thread was pinned or given a
+  /// FIFO priority here - i.e. it is the tuned thread itself,
+  /// not one that inherited the settings
+  static bool isTuned();
+
+  /// Lock the pages of a long-lived buffer in memory. Only the
+  /// buffer is locked, so later allocations are not limited by
+  /// RLIMIT_MEMLOCK.
+  static int lockBuffer(const void *addr, size_t len,
+                        std::string &errStr);
+
+  /// Unlock a buffer locked with lockBuffer(), before it is freed
+  static int unlockBuffer(const void *addr, size_t len,
+                          std::string &errStr);
+
+  /// Ask for transparent huge pages to back a buffer
+  static int adviseHugePages(void *addr, size_t len,
+                             std::string &errStr);
+
+};
+
+#endif /*THREADTUNING_H_*/
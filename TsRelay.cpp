@@ -0,0 +1,400 @@
+// *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* 
+// ** Copyright UCAR (c) 1990 - 2016                                         
+// ** University Corporation for Atmospheric Research (UCAR)                 
+// ** National Center for Atmospheric Research (NCAR)                        
+// ** Boulder, Colorado, USA                                                 
+// ** BSD licence applies - redistribution and use in source and binary      
+// ** forms, with or without modification, are permitted provided that       
+// ** the following conditions are met:                                      
+// ** 1) If the software is modified to produce derivative works,            
+// ** such modified software should be clearly marked, so as not             
+// ** to confuse it with the version available from UCAR.                    
+// ** 2) Redistributions of source code must retain the above copyright      
+// ** notice, this list of conditions and the following disclaimer.          
+// ** 3) Redistributions in binary form must reproduce the above copyright   
+// ** notice, this list of conditions and the following disclaimer in the    
+// ** documentation and/or other materials provided with the distribution.   
+// ** 4) Neither the name of UCAR nor the names of its contributors,         
+// ** if any, may be used to endorse or promote products derived from        
+// ** this software without specific prior written permission.               
+// ** DISCLAIMER: THIS SOFTWARE IS PROVIDED "AS IS" AND WITHOUT ANY EXPRESS  
+// ** OR IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED      
+// ** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.    
+// *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=* 
+/*
+ * TsRelay.cpp
+ *
+ * Relays an IWRF time series stream to remote scopes in the
+ * compressed form read by tcpscope --compressed.
+ *
+ * Pulses are windowed in range, requantized and LZ4 compressed,
+ * see CompressedTs.h. Client sockets are non-blocking, each with a
+ * bounded queue of whole packets: a slow client loses packets, and
+ * never holds up reading or the other clients. To try it on one host:
+ *
+ *   tsrelay --host radar --port 12000 --outPort 12010 --debug 1
+ *   tcpscope --compressed --host localhost --port 12010
+ */
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <boost/program_options.hpp>
+#include <toolsa/uusleep.h>
+#include <radar/IwrfTsReader.hh>
+#include <radar/IwrfTsPulse.hh>
+#include <radar/IwrfTsBurst.hh>
+#include <QElapsedTimer>
+
+#include "CompressedTs.h"
+#include "IwrfStreamReader.h"
+
+using namespace std;
+
+string _serverHost;      ///< The host name for the time series server
+int _serverPort;         ///< The port for the time series server
+string _serverFmq;       ///< The FMQ name, if using fmq instead of tcp
+int _outPort;            ///< Port for compressed clients
+int _radarId;
+int _startGate;          ///< First gate relayed
+int _maxGates;           ///< Maximum gates relayed, 0 for all
+int _nBits;              ///< Bits kept per IQ value
+int _clientQueueKb;      ///< Bytes queued per client before dropping
+double _statsSecs;       ///< Interval for printing stats
+int _debugLevel;
+
+namespace po = boost::program_options;
+
+//////////////////////////////////////////////////////////////////////
+//
+/// Parse the command line options
+void parseOptions(int argc,
+                  char** argv)
+{
+
+  _serverHost = "localhost";
+  _serverPort = 10000;
+  _serverFmq.clear();
+  _outPort = 10010;
+  _radarId = 0;
+  _startGate = 0;
+  _maxGates = 0;
+  _nBits = 10;
+  _clientQueueKb = 4096;
+  _statsSecs = 10.0;
+  _debugLevel = 0;
+
+  po::options_description descripts("Options");
+  descripts.add_options()
+    ("help", "describe options")
+    ("fmq", po::value<string>(&_serverFmq), "Set the FMQ path - if FMQ mode")
+    ("host", po::value<string>(&_serverHost), "Set the server host")
+    ("port", po::value<int>(&_serverPort), "Set the server port")
+    ("outPort", po::value<int>(&_outPort),
+     "Port on which to serve the compressed stream")
+    ("radarId", po::value<int>(&_radarId),
+     "Set radarId if data contains multiple IDs, 0 uses all data")
+    ("startGate", po::value<int>(&_startGate), "First gate to relay")
+    ("nGates", po::value<int>(&_maxGates),
+     "Maximum number of gates to relay, 0 for all")
+    ("bits", po::value<int>(&_nBits),
+     "Bits kept per IQ value, 2 to 16. Fewer compress further but keep "
+     "less dynamic range below the peak - about 6 dB per bit, 54 dB at "
+     "the default of 10")
+    ("clientQueueKb", po::value<int>(&_clientQueueKb),
+     "Data queued for a slow client before packets are dropped, KB")
+    ("statsSecs", po::value<double>(&_statsSecs),
+     "Interval for printing bandwidth stats in debug mode")
+    ("debug", po::value<int>(&_debugLevel),
+     "Set the debug level: 0, 1, or 2. 0 is the default")
+    ;
+
+  po::variables_map vm;
+  try {
+    po::store(po::parse_command_line(argc, argv, descripts), vm);
+  }
+  catch(exception & ex) {
+    cerr << "ERROR parsing command line: " << ex.what() << endl;
+    cerr << descripts << endl;
+    exit(1);
+  }
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    cout << descripts << endl;
+    exit(1);
+  }
+
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+/// Create the reader for the raw stream
+IwrfTsReader *createReader()
+{
+
+  IwrfTsReader *reader;
+  if (_serverFmq.size() > 0) {
+    reader = new IwrfTsReaderFmq(_serverFmq.c_str());
+    if (_radarId != 0) {
+      reader->setRadarId(_radarId);
+    }
+    reader->setNonBlocking(10);
+  } else {
+    // filters on radar id itself, and never blocks
+    reader = new IwrfStreamReader(_serverHost, _serverPort,
+                                  _radarId, _debugLevel);
+  }
+  return reader;
+
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+/// A compressed stream client. Packets are shared between the
+/// client queues. Only the packet at the front may be part sent.
+
+typedef std::shared_ptr< const vector<ui08> > packet_ptr_t;
+
+typedef struct {
+  int fd;
+  deque<packet_ptr_t> queue;
+  size_t sentBytes;   // of the packet at the front
+  size_t queuedBytes;
+  si64 nDropped;
+} client_t;
+
+//////////////////////////////////////////////////////////////////////
+//
+/// Open the non-blocking listening socket
+/// @return the socket, or -1 on failure
+int openServer(int port)
+{
+
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) ||
+      listen(fd, 8)) {
+    close(fd);
+    return -1;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  return fd;
+
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+/// Accept waiting clients
+void acceptClients(int serverFd, vector<client_t> &clients)
+{
+
+  while (true) {
+    int fd = accept(serverFd, NULL, NULL);
+    if (fd < 0) {
+      return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    client_t client;
+    client.fd = fd;
+    client.sentBytes = 0;
+    client.queuedBytes = 0;
+    client.nDropped = 0;
+    clients.push_back(client);
+    if (_debugLevel) {
+      cerr << "tsrelay: new client" << endl;
+    }
+  }
+
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+/// Queue a packet for all clients. A client whose queue is full
+/// loses the whole packet, so the stream stays in step.
+void queueToClients(vector<client_t> &clients, const packet_ptr_t &packet)
+{
+
+  size_t maxQueued = (size_t) _clientQueueKb * 1024;
+  for (size_t ii = 0; ii < clients.size(); ii++) {
+    client_t &client = clients[ii];
+    if (client.queuedBytes + packet->size() > maxQueued) {
+      client.nDropped++;
+      continue;
+    }
+    client.queue.push_back(packet);
+    client.queuedBytes += packet->size();
+  }
+
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+/// Send what each client will take without blocking, dropping
+/// clients whose connection has failed
+void flushClients(vector<client_t> &clients)
+{
+
+  for (size_t ii = 0; ii < clients.size(); ) {
+
+    client_t &client = clients[ii];
+    bool failed = false;
+    while (!client.queue.empty()) {
+      const vector<ui08> &packet = *client.queue.front();
+      ssize_t nSent = send(client.fd, &packet[client.sentBytes],
+                           packet.size() - client.sentBytes,
+                           MSG_DONTWAIT | MSG_NOSIGNAL);
+      if (nSent < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+          failed = true;
+        }
+        break;
+      }
+      client.sentBytes += nSent;
+      if (client.sentBytes == packet.size()) {
+        client.queuedBytes -= packet.size();
+        client.queue.pop_front();
+        client.sentBytes = 0;
+      }
+    }
+
+    if (failed) {
+      if (_debugLevel) {
+        cerr << "tsrelay: dropping client, write failed" << endl;
+      }
+      close(client.fd);
+      clients.erase(clients.begin() + ii);
+    } else {
+      ii++;
+    }
+
+  }
+
+}
+
+int
+  main (int argc, char** argv) {
+
+  parseOptions(argc, argv);
+
+  int serverFd = openServer(_outPort);
+  if (serverFd < 0) {
+    cerr << "ERROR - tsrelay: cannot open server on port "
+         << _outPort << endl;
+    cerr << "  " << strerror(errno) << endl;
+    return 1;
+  }
+  if (_debugLevel) {
+    cerr << "tsrelay: serving compressed stream on port "
+         << _outPort << endl;
+  }
+
+  IwrfTsReader *reader = createReader();
+  vector<client_t> clients;
+  si64 lastBurstSeqNum = -1;
+
+  // stats
+
+  double rawBytes = 0.0;
+  double sentBytes = 0.0;
+  double encodeSecs = 0.0;
+  si64 nPulses = 0;
+  QElapsedTimer statsTimer;
+  statsTimer.start();
+  QElapsedTimer encodeTimer;
+
+  while (true) {
+
+    // accept new clients, and send what they will take
+
+    acceptClients(serverFd, clients);
+    flushClients(clients);
+
+    // read a pulse
+
+    IwrfTsPulse *pulse = reader->getNextPulse(true);
+    if (pulse == NULL) {
+      if (!reader->getTimedOut()) {
+        // server gone away - start again after a pause
+        cerr << "WARNING - tsrelay: read failed, reconnecting" << endl;
+        delete reader;
+        umsleep(1000);
+        reader = createReader();
+      }
+      continue;
+    }
+
+    // relay the burst when it changes
+
+    const IwrfTsBurst &burst = reader->getBurst();
+    if (burst.getNSamples() > 1 &&
+        burst.getPulseSeqNum() != lastBurstSeqNum) {
+      lastBurstSeqNum = burst.getPulseSeqNum();
+      vector<ui08> *packet = new vector<ui08>;
+      packet_ptr_t packetPtr(packet);
+      if (CompressedTs::encodeBurst(burst, *packet) == 0) {
+        queueToClients(clients, packetPtr);
+        sentBytes += packet->size();
+      }
+    }
+
+    // relay the pulse
+
+    vector<ui08> *packet = new vector<ui08>;
+    packet_ptr_t packetPtr(packet);
+    encodeTimer.start();
+    int iret = CompressedTs::encodePulse(*pulse, _startGate, _maxGates,
+                                         _nBits, *packet);
+    encodeSecs += encodeTimer.nsecsElapsed() / 1.0e9;
+    rawBytes += (double) pulse->getNGates() * pulse->getNChannels() *
+      2 * sizeof(fl32);
+    nPulses++;
+    delete pulse;
+    if (iret == 0) {
+      queueToClients(clients, packetPtr);
+      sentBytes += packet->size();
+    }
+
+    // stats
+
+    if (_debugLevel && statsTimer.elapsed() > _statsSecs * 1000.0) {
+      double secs = statsTimer.elapsed() / 1000.0;
+      si64 nDropped = 0;
+      for (size_t ii = 0; ii < clients.size(); ii++) {
+        nDropped += clients[ii].nDropped;
+      }
+      cerr << "tsrelay: nClients " << clients.size()
+           << ", packets dropped for slow clients " << nDropped
+           << ", in " << rawBytes / secs / 1.0e6 << " MB/s"
+           << ", out " << sentBytes / secs / 1.0e6 << " MB/s"
+           << ", ratio " << (sentBytes > 0 ? rawBytes / sentBytes : 0.0)
+           << ", encode "
+           << (nPulses > 0 ? encodeSecs * 1.0e6 / nPulses : 0.0)
+           << " usecs/pulse" << endl;
+      rawBytes = 0.0;
+      sentBytes = 0.0;
+      encodeSecs = 0.0;
+      nPulses = 0;
+      statsTimer.restart();
+    }
+
+  } // while
+
+  return 0;
+}
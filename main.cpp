@@ -32,11 +32,16 @@
 
 #include <QApplication>
 #include <QPushButton>
+#include <QThread>
+#include <QTimer>
 
 #include <iostream>
 #include <boost/program_options.hpp>
 #include "QtConfig.h"
 #include "AScopeReader.h"
+#include "RangeTimeHistory.h"
+#include "ThreadTuning.h"
+#include "ScopeSnapshotter.h"
 #include "AScope.h"
 #include <radar/iwrf_data.h>
 
@@ -50,8 +55,23 @@ int _debugLevel;
 string _saveDir;            ///< The image save directory
 string _title;
 bool _simulMode;
+bool _compressed;        ///< Read the compressed stream from tsrelay
 int _radarId;
 int _burstChan;
+double _stallSecs;       ///< Reconnect if no data for this long
+int _decimateWidth;      ///< Display width for decimation, 0 for off
+int _historyRows;        ///< Blocks kept in range-time history, 0 for off
+int _historyGates;       ///< Range bins per history row
+double _historyMins;     ///< Age limit for range-time history
+string _gapAction;       ///< none, discard or split on sequence gaps
+string _ingestCpus;      ///< Cpus for the ingest thread, e.g. "2,3"
+int _rtPriority;         ///< SCHED_FIFO priority for ingest, 0 for off
+bool _lockMemory;        ///< Lock ingest buffers in memory
+bool _hugePages;         ///< Use huge pages for large buffers
+double _jitterReportSecs; ///< Ingest jitter report interval, 0 for off
+double _snapshotSecs;    ///< Interval for saving images, 0 for off
+int _snapshotQueue;      ///< Images waiting to be written before dropping
+bool _headless;          ///< Run without a display
 
 namespace po = boost::program_options;
 
@@ -74,6 +94,20 @@ void getConfigParams()
   _debugLevel = 0;
   _radarId = 0;
   _burstChan = -1;
+  _stallSecs = config.getDouble("StallSecs", 0.0);
+  _decimateWidth = config.getInt("DecimateWidth", 0);
+  _historyRows = config.getInt("HistoryRows", 0);
+  _historyGates = config.getInt("HistoryGates", 1000);
+  _historyMins = config.getDouble("HistoryMins", 10.0);
+  _gapAction = config.getString("GapAction", "none");
+  _ingestCpus = config.getString("IngestCpus", "");
+  _rtPriority = config.getInt("RtPriority", 0);
+  _lockMemory = config.getBool("LockMemory", false);
+  _hugePages = config.getBool("HugePages", false);
+  _jitterReportSecs = config.getDouble("JitterReportSecs", 0.0);
+  _snapshotSecs = config.getDouble("SnapshotSecs", 0.0);
+  _snapshotQueue = config.getInt("SnapshotQueue", 4);
+  _headless = config.getBool("Headless", false);
 
 }
 
@@ -97,10 +131,37 @@ void parseOptions(int argc,
     ("host", po::value<string>(&_serverHost), "Set the server host")
     ("port", po::value<int>(&_serverPort), "Set the server port")
     ("simul", "use simultanous mode")
+    ("compressed", "read the compressed stream from tsrelay on host/port")
     ("radarId", po::value<int>(&_radarId),
      "Set radarId if data contains multiple IDs, 0 uses all data")
     ("burstChan", po::value<int>(&_burstChan),
      "Set burst channel (0 to 3) in alternating mode")
+    ("stallSecs", po::value<double>(&_stallSecs),
+     "Reconnect if no data arrives for this many secs, 0 to disable")
+    ("decimate", po::value<int>(&_decimateWidth),
+     "Reduce long beams to a min/max envelope this many columns wide")
+    ("historyRows", po::value<int>(&_historyRows),
+     "Keep a range-time history of this many blocks, 0 to disable")
+    ("historyGates", po::value<int>(&_historyGates),
+     "Number of range bins per history block")
+    ("historyMins", po::value<double>(&_historyMins),
+     "Drop history blocks older than this many minutes")
+    ("gapAction", po::value<string>(&_gapAction),
+     "On pulse sequence gaps: none, discard or split the block")
+    ("cpus", po::value<string>(&_ingestCpus),
+     "Pin the ingest thread to these cpus, e.g. 2,3 or 2-3")
+    ("rtPriority", po::value<int>(&_rtPriority),
+     "Run ingest under SCHED_FIFO at this priority (1-99), 0 for off")
+    ("lockMemory", "lock the ingest buffers in memory to avoid page faults")
+    ("hugePages", "use huge pages for the history buffer")
+    ("jitterReportSecs", po::value<double>(&_jitterReportSecs),
+     "Report ingest timer lateness every this many secs, 0 for off")
+    ("snapshotSecs", po::value<double>(&_snapshotSecs),
+     "Save an image of the scope to SaveDir every this many secs "
+     "(at least 1), 0 for off")
+    ("snapshotQueue", po::value<int>(&_snapshotQueue),
+     "Images waiting to be written before frames are dropped")
+    ("headless", "run without a display, using the offscreen platform")
     ("debug", po::value<int>(&_debugLevel),
      "Set the debug level: 0, 1, or 2. 0 is the default")
     ;
@@ -126,8 +187,98 @@ void parseOptions(int argc,
     _simulMode = true;
   }
 
+  _compressed = false;
+  if (vm.count("compressed")) {
+    _compressed = true;
+    if (_serverFmq.size() > 0) {
+      cerr << "ERROR - compressed mode reads from host/port, not fmq" << endl;
+      exit(1);
+    }
+  }
+
+  if (vm.count("lockMemory")) {
+    _lockMemory = true;
+  }
+  if (vm.count("hugePages")) {
+    _hugePages = true;
+  }
+  if (vm.count("headless")) {
+    _headless = true;
+  }
+  if (_snapshotSecs > 0 &&
+      _snapshotSecs < ScopeSnapshotter::MIN_INTERVAL_SECS) {
+    cerr << "ERROR - snapshotSecs must be at least "
+         << ScopeSnapshotter::MIN_INTERVAL_SECS
+         << ", image file names are to the second" << endl;
+    exit(1);
+  }
+  if (_headless && _snapshotSecs <= 0) {
+    cerr << "WARNING - headless with no snapshots, nothing will be seen"
+         << endl;
+  }
+
+  if (_historyRows > 0) {
+    if (_historyGates < 1) {
+      cerr << "ERROR - historyGates must be at least 1" << endl;
+      exit(1);
+    }
+    size_t historyBytes =
+      RangeTimeHistory::getPowerBytes(_historyRows, _historyGates);
+    if (historyBytes > RangeTimeHistory::MAX_POWER_BYTES) {
+      cerr << "ERROR - history of " << _historyRows << " rows by "
+           << _historyGates << " gates needs " << historyBytes
+           << " bytes, limit is " << RangeTimeHistory::MAX_POWER_BYTES
+           << endl;
+      exit(1);
+    }
+  }
+
+  if (_gapAction != "none" && _gapAction != "discard" &&
+      _gapAction != "split") {
+    cerr << "ERROR - gapAction must be none, discard or split" << endl;
+    cerr << descripts << endl;
+    exit(1);
+  }
+
 }
 
+//////////////////////////////////////////////////////////////////////
+///
+/// Apply cpu pinning, real-time priority and memory locking to the
+/// ingest thread, as requested. Called in the ingest thread, so that
+/// no other thread is affected. Failures are warnings, not errors.
+void tuneIngest(AScopeReader &reader)
+{
+
+  string errStr;
+
+  if (_ingestCpus.size() > 0) {
+    vector<int> cpus;
+    if (ThreadTuning::parseCpuList(_ingestCpus, cpus, errStr) ||
+        ThreadTuning::pinToCpus(cpus, errStr)) {
+      cerr << "WARNING - " << errStr << endl;
+    } else if (_debugLevel) {
+      cerr << "  ingest pinned to cpus: " << _ingestCpus << endl;
+    }
+  }
+
+  if (_rtPriority > 0) {
+    if (ThreadTuning::setFifoPriority(_rtPriority, errStr)) {
+      cerr << "WARNING - " << errStr << endl;
+    } else if (_debugLevel) {
+      cerr << "  ingest SCHED_FIFO priority: " << _rtPriority << endl;
+    }
+  }
+
+  if (_lockMemory) {
+    if (reader.lockBuffers(errStr)) {
+      cerr << "WARNING - " << errStr << endl;
+    } else if (_debugLevel) {
+      cerr << "  ingest buffers locked" << endl;
+    }
+  }
+
+}
 
 int
   main (int argc, char** argv) {
@@ -148,6 +299,12 @@ int
     }
   }
 
+  // headless - the platform must be chosen before the application
+
+  if (_headless) {
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+  }
+
   QApplication app(argc, argv);
   
   // create the scope
@@ -158,18 +315,79 @@ int
 
   // create the data source reader
   
-  AScopeReader reader(_serverHost, _serverPort, _serverFmq,
-                      _simulMode, scope, _radarId, _burstChan, _debugLevel);
-  
+  AScopeReader *reader =
+    new AScopeReader(_serverHost, _serverPort, _serverFmq,
+                     _simulMode, scope, _radarId, _burstChan, _debugLevel);
+  reader->setCompressed(_compressed);
+  reader->setStallSecs(_stallSecs);
+  reader->setDecimateWidth(_decimateWidth);
+  reader->setHugePages(_hugePages);
+  reader->setHistory(_historyRows, _historyGates, _historyMins * 60.0);
+  if (_gapAction == "discard") {
+    reader->setGapAction(AScopeReader::GAP_ACTION_DISCARD);
+  } else if (_gapAction == "split") {
+    reader->setGapAction(AScopeReader::GAP_ACTION_SPLIT);
+  }
+  reader->setJitterReportSecs(_jitterReportSecs);
+
+  // snapshots - the writer thread is started from this thread,
+  // so it is not affected by the ingest tuning
+
+  ScopeSnapshotter *snapshotter = NULL;
+  if (_snapshotSecs > 0) {
+    snapshotter = new ScopeSnapshotter(scope, _saveDir, _title,
+                                       _snapshotSecs, _snapshotQueue,
+                                       _debugLevel);
+  }
+
   // connect the reader to the scope to receive new time series data
   
-  scope.connect(&reader, SIGNAL(newItem(AScope::TimeSeries)),
+  scope.connect(reader, SIGNAL(newItem(AScope::TimeSeries)),
                 &scope, SLOT(newTSItemSlot(AScope::TimeSeries)));
   
   // connect the scope to the reader to return used time series data
 
   scope.connect(&scope, SIGNAL(returnTSItem(AScope::TimeSeries)),
-                &reader, SLOT(returnItemSlot(AScope::TimeSeries)));
+                reader, SLOT(returnItemSlot(AScope::TimeSeries)));
+
+  // ingest runs in its own thread, from the reader's timer, so that
+  // drawing does not hold it up. The tuning is applied in that
+  // thread once it starts. Each setting is optional - without the
+  // privileges for it we warn and carry on.
+
+  QThread ingestThread;
+  reader->moveToThread(&ingestThread);
+  QObject::connect(&ingestThread, &QThread::started, reader,
+                   [reader]() { tuneIngest(*reader); });
+  ingestThread.start();
+
+  // the block size is set on the scope, in this thread
+
+  QTimer blockSizeTimer;
+  QObject::connect(&blockSizeTimer, &QTimer::timeout,
+                   [reader, &scope]() {
+                     reader->setBlockSize(scope.getBlockSize());
+                   });
+  blockSizeTimer.start(200);
+
+  int iret = app.exec();
+
+  QMetaObject::invokeMethod(reader, "stop", Qt::BlockingQueuedConnection);
+  ingestThread.quit();
+  ingestThread.wait();
+
+  if (snapshotter) {
+    if (_debugLevel) {
+      cerr << "Snapshots saved: " << snapshotter->getNSaved()
+           << ", dropped: " << snapshotter->getNDropped() << endl;
+    }
+    delete snapshotter;
+  }
+
+  if (_debugLevel) {
+    reader->printStats(cerr);
+  }
+  delete reader;
 
-  return app.exec();
+  return iret;
 }